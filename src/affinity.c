@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+
+#include "affinity.h"
+#include "panic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef __linux__
+#include <sched.h>
+#define HAS_AFFINITY
+#endif
+
+#define AFFINITY_MAX_NODES 64
+#define AFFINITY_MAX_CPUS  1024
+
+typedef struct TopologyS {
+	// CPUs of all nodes, node by node
+	size_t cpus[AFFINITY_MAX_CPUS];
+	size_t cpu_count;
+	// node n has the CPUs cpus[offsets[n]] ... cpus[offsets[n + 1] - 1]
+	size_t offsets[AFFINITY_MAX_NODES + 1];
+	size_t node_count;
+} Topology;
+
+static void read_topology(Topology *topology);
+
+size_t affinity_parse_list(const char *str, size_t cpus[], size_t size) {
+	size_t count = 0;
+	const char *ptr = str;
+
+	for (;;) {
+		char *endptr = NULL;
+		if (!isdigit((unsigned char)*ptr)) {
+			return 0;
+		}
+		const unsigned long first = strtoul(ptr, &endptr, 10);
+		unsigned long last = first;
+		ptr = endptr;
+
+		if (*ptr == '-') {
+			++ ptr;
+			if (!isdigit((unsigned char)*ptr)) {
+				return 0;
+			}
+			last = strtoul(ptr, &endptr, 10);
+			ptr = endptr;
+		}
+
+		if (last < first || last >= AFFINITY_MAX_CPUS) {
+			return 0;
+		}
+
+		for (unsigned long cpu = first; cpu <= last; ++ cpu) {
+			if (count < size) {
+				cpus[count] = cpu;
+			}
+			++ count;
+		}
+
+		if (*ptr == ',') {
+			++ ptr;
+		}
+		else if (*ptr == '\0' || *ptr == '\n') {
+			break;
+		}
+		else {
+			return 0;
+		}
+	}
+
+	return count;
+}
+
+// Reads the NUMA nodes and their CPUs, limited to the CPUs this process may
+// run on. Without NUMA information all CPUs are put into one node.
+void read_topology(Topology *topology) {
+	bool allowed[AFFINITY_MAX_CPUS];
+	size_t allowed_count = 0;
+
+#ifdef HAS_AFFINITY
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+		panice("getting CPU affinity of process");
+	}
+	for (size_t cpu = 0; cpu < AFFINITY_MAX_CPUS; ++ cpu) {
+		allowed[cpu] = cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set);
+		if (allowed[cpu]) {
+			++ allowed_count;
+		}
+	}
+#else
+	for (size_t cpu = 0; cpu < AFFINITY_MAX_CPUS; ++ cpu) {
+		allowed[cpu] = false;
+	}
+	allowed[0] = true;
+	allowed_count = 1;
+#endif
+
+	topology->cpu_count = 0;
+	topology->node_count = 0;
+	topology->offsets[0] = 0;
+
+	for (unsigned int node = 0; node < AFFINITY_MAX_NODES; ++ node) {
+		char path[64];
+		char line[4096];
+		size_t cpus[AFFINITY_MAX_CPUS];
+
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+		FILE *fp = fopen(path, "r");
+		if (!fp) {
+			continue;
+		}
+		const bool ok = fgets(line, sizeof(line), fp) != NULL;
+		fclose(fp);
+		if (!ok) {
+			continue;
+		}
+
+		size_t count = affinity_parse_list(line, cpus, AFFINITY_MAX_CPUS);
+		if (count > AFFINITY_MAX_CPUS) {
+			count = AFFINITY_MAX_CPUS;
+		}
+
+		const size_t offset = topology->cpu_count;
+		for (size_t index = 0; index < count; ++ index) {
+			const size_t cpu = cpus[index];
+			if (allowed[cpu] && topology->cpu_count < AFFINITY_MAX_CPUS) {
+				topology->cpus[topology->cpu_count ++] = cpu;
+				// don't count CPUs twice if the node info is inconsistent
+				allowed[cpu] = false;
+			}
+		}
+
+		if (topology->cpu_count > offset) {
+			++ topology->node_count;
+			topology->offsets[topology->node_count] = topology->cpu_count;
+		}
+	}
+
+	if (topology->node_count == 0 || topology->cpu_count == 0) {
+		topology->cpu_count = 0;
+		for (size_t cpu = 0; cpu < AFFINITY_MAX_CPUS && topology->cpu_count < allowed_count; ++ cpu) {
+			if (allowed[cpu]) {
+				topology->cpus[topology->cpu_count ++] = cpu;
+			}
+		}
+		topology->node_count = 1;
+		topology->offsets[1] = topology->cpu_count;
+	}
+}
+
+void affinity_plan(
+	Affinity policy, const size_t list[], size_t list_count,
+	size_t tasks, size_t cpus[]) {
+
+	if (policy == AffinityList) {
+		if (list_count == 0) {
+			panicf("empty CPU list");
+		}
+		for (size_t index = 0; index < tasks; ++ index) {
+			cpus[index] = list[index % list_count];
+		}
+		return;
+	}
+
+	Topology *topology = malloc(sizeof(Topology));
+	if (!topology) {
+		panice("allocating CPU topology");
+	}
+	read_topology(topology);
+
+	switch (policy) {
+	case AffinityCompact:
+		for (size_t index = 0; index < tasks; ++ index) {
+			cpus[index] = topology->cpus[index % topology->cpu_count];
+		}
+		break;
+
+	case AffinityScatter:
+		for (size_t index = 0; index < tasks; ++ index) {
+			const size_t node = index % topology->node_count;
+			const size_t offset = topology->offsets[node];
+			const size_t node_size = topology->offsets[node + 1] - offset;
+			cpus[index] = topology->cpus[offset + (index / topology->node_count) % node_size];
+		}
+		break;
+
+	default:
+		panicf("illegal affinity policy");
+	}
+
+	free(topology);
+}
+
+#ifdef HAS_AFFINITY
+void affinity_set_attr(pthread_attr_t *attr, size_t cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	const int errnum = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+	if (errnum != 0) {
+		panicf("setting worker thread affinity to CPU %zu: %s", cpu, strerror(errnum));
+	}
+}
+#else
+void affinity_set_attr(pthread_attr_t *attr, size_t cpu) {
+	(void)attr;
+	(void)cpu;
+	panicf("pinning threads to CPUs is not supported on this platform");
+}
+#endif
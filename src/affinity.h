@@ -0,0 +1,41 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum AffinityE {
+	// don't pin worker threads
+	AffinityNone = 0,
+	// fill up the CPUs of one NUMA node before using the next node
+	AffinityCompact,
+	// distribute worker threads round-robin over the NUMA nodes
+	AffinityScatter,
+	// use the given list of CPUs (round-robin)
+	AffinityList
+} Affinity;
+
+// Parses a CPU list like "0-3,8,10-11" into cpus (up to size entries) and
+// returns the number of CPUs in the list or 0 on syntax error. The returned
+// number may be bigger than size, in which case the list got truncated.
+size_t affinity_parse_list(const char *str, size_t cpus[], size_t size);
+
+// Fills cpus[0..tasks) with the CPU each worker thread shall be pinned to.
+void affinity_plan(
+	Affinity policy, const size_t list[], size_t list_count,
+	size_t tasks, size_t cpus[]);
+
+// Sets the affinity of threads that will be created with attr to cpu.
+void affinity_set_attr(pthread_attr_t *attr, size_t cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AFFINITY_H
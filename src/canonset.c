@@ -0,0 +1,79 @@
+#include "canonset.h"
+#include "panic.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// 0 marks an empty slot, so it is mapped to another key. This makes hashes 0
+// and 1 collide, which is as likely as any other collision.
+#define CANONSET_KEY(KEY) ((KEY) == 0 ? 1 : (KEY))
+
+static void canonset_resize(CanonSet *set, size_t capacity);
+
+void canonset_resize(CanonSet *set, size_t capacity) {
+	Hash *keys = calloc(capacity, sizeof(Hash));
+	if (!keys) {
+		panice("resizing canonical hash set");
+	}
+
+	const size_t mask = capacity - 1;
+	for (size_t index = 0; index < set->capacity; ++ index) {
+		const Hash key = set->keys[index];
+		if (key != 0) {
+			size_t slot = key & mask;
+			while (keys[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			keys[slot] = key;
+		}
+	}
+
+	free(set->keys);
+	set->keys = keys;
+	set->capacity = capacity;
+}
+
+bool canonset_contains(const CanonSet *set, Hash key) {
+	if (set->capacity == 0) {
+		return false;
+	}
+
+	key = CANONSET_KEY(key);
+	const size_t mask = set->capacity - 1;
+	for (size_t slot = key & mask; set->keys[slot] != 0; slot = (slot + 1) & mask) {
+		if (set->keys[slot] == key) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool canonset_add(CanonSet *set, Hash key) {
+	// keep the load factor at or below 1/2
+	if (set->size >= set->capacity / 2) {
+		if (SIZE_MAX / 2 / sizeof(Hash) < set->capacity) {
+			panicf("integer overflow");
+		}
+		canonset_resize(set, set->capacity == 0 ? CANONSET_INIT_CAPACITY : set->capacity * 2);
+	}
+
+	key = CANONSET_KEY(key);
+	const size_t mask = set->capacity - 1;
+	size_t slot = key & mask;
+	for (; set->keys[slot] != 0; slot = (slot + 1) & mask) {
+		if (set->keys[slot] == key) {
+			return false;
+		}
+	}
+
+	set->keys[slot] = key;
+	set->size ++;
+	return true;
+}
+
+void canonset_free(CanonSet *set) {
+	free(set->keys);
+	set->keys     = NULL;
+	set->size     = 0;
+	set->capacity = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef CANONSET_H
+#define CANONSET_H
+#pragma once
+
+#include "expr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hash set of canonical expression hashes (see expr_hash()), used to drop
+// expressions that are equivalent to an already stored one.
+#define CANONSET_INIT_CAPACITY 16
+#define CANONSET_INIT { .keys = NULL, .size = 0, .capacity = 0 }
+
+typedef struct CanonSetS {
+	Hash *keys;
+	size_t size;
+	size_t capacity;
+} CanonSet;
+
+bool canonset_contains(const CanonSet *set, Hash key);
+bool canonset_add(CanonSet *set, Hash key);
+void canonset_free(CanonSet *set);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
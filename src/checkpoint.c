@@ -0,0 +1,282 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint.h"
+#include "panic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define CHECKPOINT_BUFFER_SIZE (1 << 20)
+
+typedef struct WriterS {
+	FILE *fp;
+	const char *path;
+	unsigned char *buf;
+	size_t len;
+} Writer;
+
+typedef struct ReaderS {
+	FILE *fp;
+	const char *path;
+	unsigned char *buf;
+	size_t len;
+	size_t pos;
+} Reader;
+
+static void writer_flush(Writer *writer);
+static void write_varint(Writer *writer, uint64_t value);
+static void write_record(Writer *writer, const Expr *expr);
+static int read_byte(Reader *reader);
+static uint64_t read_varint(Reader *reader);
+static Expr *read_record(Reader *reader, const ExprBuf *exprs);
+
+void writer_flush(Writer *writer) {
+	if (fwrite(writer->buf, 1, writer->len, writer->fp) != writer->len) {
+		panice(writer->path);
+	}
+	writer->len = 0;
+}
+
+void write_varint(Writer *writer, uint64_t value) {
+	if (writer->len + EXPR_VARINT_MAX_SIZE > CHECKPOINT_BUFFER_SIZE) {
+		writer_flush(writer);
+	}
+	writer->len += expr_encode_varint(writer->buf + writer->len, value);
+}
+
+// While writing, the canon field of already written expressions holds their
+// index (see checkpoint_write()).
+void write_record(Writer *writer, const Expr *expr) {
+	write_varint(writer, (uint64_t)expr->op);
+	if (expr->op == OpVal) {
+		write_varint(writer, expr->value);
+		write_varint(writer, expr->u.index);
+	}
+	else {
+		write_varint(writer, expr->u.e.left->canon);
+		write_varint(writer, expr->u.e.right->canon);
+	}
+	write_varint(writer, expr->generation);
+}
+
+// Mapping operands to indices with a hash map is a random access per operand
+// into a table as big as the whole expression list, so instead the canonical
+// signatures are temporarily replaced by the indices and restored afterwards.
+// No workers may access the expressions meanwhile.
+void checkpoint_write(const char *path, const Checkpoint *checkpoint, const ExprBuf *exprs, const ExprBuf *solutions) {
+	const size_t path_len = strlen(path);
+	char *tmp_path = malloc(path_len + 5);
+	if (!tmp_path) {
+		panice("allocating checkpoint path");
+	}
+	memcpy(tmp_path, path, path_len);
+	memcpy(tmp_path + path_len, ".tmp", 5);
+
+	Writer writer = {
+		.fp = fopen(tmp_path, "wb"),
+		.path = tmp_path,
+		.buf = malloc(CHECKPOINT_BUFFER_SIZE),
+		.len = 0
+	};
+
+	if (!writer.fp) {
+		panice(tmp_path);
+	}
+
+	if (!writer.buf) {
+		panice("allocating checkpoint buffer");
+	}
+
+	Hash *canons = calloc(exprs->size == 0 ? 1 : exprs->size, sizeof(Hash));
+	if (!canons) {
+		panice("allocating checkpoint buffer");
+	}
+
+	memcpy(writer.buf, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+	writer.len = CHECKPOINT_MAGIC_SIZE;
+	write_varint(&writer, checkpoint->target);
+	write_varint(&writer, (uint64_t)checkpoint->bound_mode);
+	write_varint(&writer, checkpoint->bound);
+	write_varint(&writer, checkpoint->max_size);
+	write_varint(&writer, checkpoint->generation);
+	write_varint(&writer, checkpoint->lower);
+	write_varint(&writer, exprs->size);
+	write_varint(&writer, solutions->size);
+
+	for (size_t index = 0; index < exprs->size; ++ index) {
+		Expr *expr = exprbuf_get(exprs, index);
+		write_record(&writer, expr);
+		canons[index] = expr->canon;
+		expr->canon = index;
+	}
+
+	for (size_t index = 0; index < solutions->size; ++ index) {
+		write_record(&writer, exprbuf_get(solutions, index));
+	}
+
+	for (size_t index = 0; index < exprs->size; ++ index) {
+		exprbuf_get(exprs, index)->canon = canons[index];
+	}
+
+	free(canons);
+	writer_flush(&writer);
+	free(writer.buf);
+
+	if (fflush(writer.fp) != 0 || fsync(fileno(writer.fp)) != 0) {
+		panice(tmp_path);
+	}
+
+	if (fclose(writer.fp) != 0) {
+		panice(tmp_path);
+	}
+
+	if (rename(tmp_path, path) != 0) {
+		panice(path);
+	}
+
+	free(tmp_path);
+}
+
+int read_byte(Reader *reader) {
+	if (reader->pos == reader->len) {
+		reader->len = fread(reader->buf, 1, CHECKPOINT_BUFFER_SIZE, reader->fp);
+		reader->pos = 0;
+		if (reader->len == 0) {
+			if (ferror(reader->fp)) {
+				panice(reader->path);
+			}
+			return EOF;
+		}
+	}
+	return reader->buf[reader->pos ++];
+}
+
+uint64_t read_varint(Reader *reader) {
+	uint64_t value = 0;
+	for (unsigned int shift = 0; shift < EXPR_VARINT_MAX_SIZE * 7; shift += 7) {
+		const int byte = read_byte(reader);
+		if (byte == EOF) {
+			panicf("%s: unexpected end of checkpoint", reader->path);
+		}
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return value;
+		}
+	}
+	panicf("%s: illegal number in checkpoint", reader->path);
+	return 0;
+}
+
+// Operands are looked up in exprs, so they have to be read already.
+Expr *read_record(Reader *reader, const ExprBuf *exprs) {
+	const int op = read_byte(reader);
+	if (op == EOF) {
+		panicf("%s: unexpected end of checkpoint", reader->path);
+	}
+
+	Expr *expr;
+	switch (op) {
+	case OpVal:
+	{
+		const Number value = read_varint(reader);
+		const uint64_t index = read_varint(reader);
+		if (index >= sizeof(NumberSet) * 8) {
+			panicf("%s: illegal number index in checkpoint: %" PRIu64, reader->path, index);
+		}
+		expr = new_val(value, (size_t)index, 0);
+		break;
+	}
+	case OpAdd:
+	case OpSub:
+	case OpMul:
+	case OpDiv:
+	{
+		const uint64_t left  = read_varint(reader);
+		const uint64_t right = read_varint(reader);
+		if (left >= exprs->size || right >= exprs->size) {
+			panicf("%s: illegal operand index in checkpoint", reader->path);
+		}
+		expr = new_expr((Op)op, exprbuf_get(exprs, left), exprbuf_get(exprs, right), 0);
+		break;
+	}
+	default:
+		panicf("%s: illegal operation in checkpoint: %d", reader->path, op);
+		return NULL;
+	}
+
+	expr->generation = read_varint(reader);
+	return expr;
+}
+
+bool checkpoint_read(const char *path, Checkpoint *checkpoint, ExprBuf *exprs, ExprBuf *solutions) {
+	Reader reader = {
+		.fp = fopen(path, "rb"),
+		.path = path,
+		.buf = NULL,
+		.len = 0,
+		.pos = 0
+	};
+
+	if (!reader.fp) {
+		if (errno == ENOENT) {
+			return false;
+		}
+		panice(path);
+	}
+
+	reader.buf = malloc(CHECKPOINT_BUFFER_SIZE);
+	if (!reader.buf) {
+		panice("allocating checkpoint buffer");
+	}
+
+	for (size_t index = 0; index < CHECKPOINT_MAGIC_SIZE; ++ index) {
+		if (read_byte(&reader) != CHECKPOINT_MAGIC[index]) {
+			panicf("%s: not a checkpoint file", path);
+		}
+	}
+
+	checkpoint->target     = read_varint(&reader);
+	checkpoint->bound_mode = (NumbersBound)read_varint(&reader);
+	checkpoint->bound      = read_varint(&reader);
+	checkpoint->max_size   = read_varint(&reader);
+	checkpoint->generation = read_varint(&reader);
+	checkpoint->lower      = read_varint(&reader);
+	const uint64_t expr_count     = read_varint(&reader);
+	const uint64_t solution_count = read_varint(&reader);
+
+	const size_t value_count = exprs->size;
+	if (expr_count < value_count || checkpoint->lower > expr_count) {
+		panicf("%s: checkpoint doesn't match the given numbers", path);
+	}
+
+	for (size_t index = 0; index < value_count; ++ index) {
+		Expr *expr = read_record(&reader, exprs);
+		const Expr *given = exprbuf_get(exprs, index);
+		if (expr->op != OpVal || expr->value != given->value || expr->u.index != given->u.index) {
+			panicf("%s: checkpoint doesn't match the given numbers", path);
+		}
+		free(expr);
+	}
+
+	for (uint64_t index = value_count; index < expr_count; ++ index) {
+		exprbuf_add(exprs, read_record(&reader, exprs));
+	}
+
+	for (uint64_t index = 0; index < solution_count; ++ index) {
+		exprbuf_add(solutions, read_record(&reader, exprs));
+	}
+
+	if (read_byte(&reader) != EOF) {
+		panicf("%s: trailing data in checkpoint", path);
+	}
+
+	free(reader.buf);
+	fclose(reader.fp);
+
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#pragma once
+
+#include "numbers.h"
+#include "exprbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A checkpoint is the state of a solve at a generation boundary. The file
+// starts with CHECKPOINT_MAGIC, followed by the header fields and the
+// expressions and then the solutions, each as one record in index order.
+// Records reference their operands by their index in the expression list,
+// which always is smaller than the index of the record itself. So a
+// checkpoint can be written and read in one sequential pass. All numbers are
+// unsigned LEB128 encoded.
+//
+// record := op:u8 (op = OpVal: value index | else: left right) generation
+#define CHECKPOINT_MAGIC "NUMCKPT1"
+#define CHECKPOINT_MAGIC_SIZE 8
+
+typedef struct CheckpointS {
+	Number target;
+	// options that change which expressions are stored
+	NumbersBound bound_mode;
+	Number bound;
+	size_t max_size;
+	// the last completed generation
+	size_t generation;
+	// expressions from here on are the ones of that generation
+	size_t lower;
+} Checkpoint;
+
+// Writes the checkpoint to path + ".tmp" and then renames it to path, so an
+// interrupted write never replaces the previous checkpoint.
+void checkpoint_write(const char *path, const Checkpoint *checkpoint, const ExprBuf *exprs, const ExprBuf *solutions);
+
+// Returns false if there is no file at path. Otherwise reads the checkpoint
+// into checkpoint and appends the stored expressions and solutions to exprs
+// and solutions. exprs has to contain exactly the expressions of the given
+// numbers, which are compared to the ones of the checkpoint.
+bool checkpoint_read(const char *path, Checkpoint *checkpoint, ExprBuf *exprs, ExprBuf *solutions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHECKPOINT_H
@@ -3,8 +3,62 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
+#define HASH_SALT_VAL 0x9e3779b97f4a7c15u
+#define HASH_SALT_ADD 0xc2b2ae3d27d4eb4fu
+#define HASH_SALT_MUL 0x165667b19e3779f9u
+#define HASH_SALT_NEG 0x27d4eb2f165667c5u
+
+// An expression uses every given number at most once, so this is the maximum
+// number of operations on the way from the root to a value.
+#define EXPR_MAX_DEPTH (sizeof(NumberSet) * 8)
+
+typedef struct FormatItemS {
+	// either an expression or a piece of text
+	const Expr *expr;
+	const char *text;
+} FormatItem;
+
+typedef struct EncodeItemS {
+	const Expr *expr;
+	bool children_done;
+} EncodeItem;
+
+#ifdef DEBUG
 static void expr_fprint_op(FILE *stream, char op, const Expr *expr);
+#endif
+static bool needs_rparen(Op op, Op right);
+static size_t format_text(char *buf, size_t size, size_t len, const char *text);
+static size_t format_number(char *buf, size_t size, size_t len, Number value);
+static size_t encode_byte(unsigned char *buf, size_t size, size_t len, unsigned char byte);
+static Hash hash_mix(Hash hash);
+static bool is_additive(Op op);
+static Hash chain_term(bool additive, const Expr *expr);
+
+// splitmix64 finalizer
+Hash hash_mix(Hash hash) {
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9u;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebu;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+bool is_additive(Op op) {
+	return op == OpAdd || op == OpSub;
+}
+
+// Contribution of expr as a term of an additive or multiplicative chain. If
+// expr is itself part of such a chain its terms are flattened into the outer
+// chain.
+Hash chain_term(bool additive, const Expr *expr) {
+	if (expr->op != OpVal && is_additive(expr->op) == additive) {
+		return expr->canon;
+	}
+	return expr_hash(expr);
+}
 
 Expr *new_val(Number value, size_t index, size_t generation) {
 	Expr *expr = malloc(sizeof(Expr));
@@ -18,6 +72,7 @@ Expr *new_val(Number value, size_t index, size_t generation) {
 	expr->value = value;
 	expr->used = 1 << index;
 	expr->generation = generation;
+	expr->canon = hash_mix(value ^ HASH_SALT_VAL);
 
 	return expr;
 }
@@ -32,50 +87,92 @@ Expr *new_expr(Op op, const Expr *left, const Expr *right, size_t generation) {
 	expr->op = op;
 	expr->u.e.left  = left;
 	expr->u.e.right = right;
+	expr->value = op_apply(op, left->value, right->value);
+	expr->used = left->used | right->used;
+	expr->generation = generation;
+	expr->canon = expr_canon(op, left, right);
 
+	return expr;
+}
+
+Number op_apply(Op op, Number left, Number right) {
 	switch (op) {
-	case OpAdd:
-		expr->value = left->value + right->value;
-		break;
+	case OpAdd: return left + right;
+	case OpSub: return left - right;
+	case OpMul: return left * right;
+	case OpDiv: return left / right;
+	default:
+		panicf("illegal operation");
+	}
+	return 0;
+}
 
-	case OpSub:
-		expr->value = left->value - right->value;
+// Like op_apply(), but returns false instead of wrapping around if the result
+// doesn't fit into Number.
+bool op_checked(Op op, Number left, Number right, Number *result) {
+	switch (op) {
+	case OpAdd:
+		if (left > NUMBER_MAX - right) {
+			return false;
+		}
 		break;
 
 	case OpMul:
-		expr->value = left->value * right->value;
-		break;
-
-	case OpDiv:
-		expr->value = left->value / right->value;
+		if (right != 0 && left > NUMBER_MAX / right) {
+			return false;
+		}
 		break;
 
 	default:
-		panicf("illegal operation");
+		break;
 	}
 
-	expr->used = left->used | right->used;
-	expr->generation = generation;
-
-	return expr;
+	*result = op_apply(op, left, right);
+	return true;
 }
 
-bool expr_equals(const Expr *left, const Expr *right) {
-	if (left == right) {
-		return true;
-	}
+// Subtracted terms and divisors are hashed differently than the other terms
+// instead of being subtracted from the signature. Otherwise they would cancel
+// out, e.g. x + 3 - 3 would get the same signature as x, even though it uses
+// more numbers.
+Hash expr_canon(Op op, const Expr *left, const Expr *right) {
+	const bool additive = is_additive(op);
+	const Hash lhash = chain_term(additive, left);
 
-	if (left->op != right->op || left->value != right->value) {
-		return false;
+	switch (op) {
+	case OpAdd:
+	case OpMul:
+		return lhash + chain_term(additive, right);
+
+	case OpSub:
+	case OpDiv:
+		// The terms of a chain on the right would have to swap signs, so
+		// it's a single term. Normalized expressions never have one there.
+		return lhash + hash_mix(expr_hash(right) ^ HASH_SALT_NEG);
+
+	default:
+		panicf("illegal operation");
 	}
+	return 0;
+}
 
-	if (left->op != OpVal) {
-		if (!expr_equals(left->u.e.left, right->u.e.left) || !expr_equals(left->u.e.right, right->u.e.right)) {
-			return false;
-		}
+// Canonical hash of an expression given its operation and signature. For
+// values the signature already is the hash.
+Hash expr_canon_hash(Op op, Hash canon) {
+	switch (op) {
+	case OpVal: return canon;
+	case OpAdd:
+	case OpSub: return hash_mix(canon ^ HASH_SALT_ADD);
+	case OpMul:
+	case OpDiv: return hash_mix(canon ^ HASH_SALT_MUL);
+	default:
+		panicf("illegal operation");
 	}
+	return 0;
+}
 
-	return true;
+Hash expr_hash(const Expr *expr) {
+	return expr_canon_hash(expr->op, expr->canon);
 }
 
 bool is_normalized_add(const Expr *left, const Expr *right) {
@@ -136,19 +233,173 @@ bool is_normalized_div(const Expr *left, const Expr *right) {
 	}
 }
 
+// Op equals to it's precedence, but the right operand of - and / also needs
+// parentheses if it has the same precedence. Normalized expressions never
+// have such a right operand, but the witnesses of --reach can.
+bool needs_rparen(Op op, Op right) {
+	return op > right ||
+		(op == OpSub && right == OpSub) ||
+		(op == OpDiv && (right == OpMul || right == OpDiv));
+}
+
+size_t format_text(char *buf, size_t size, size_t len, const char *text) {
+	for (; *text; ++ text, ++ len) {
+		if (len < size) {
+			buf[len] = *text;
+		}
+	}
+	return len;
+}
+
+size_t format_number(char *buf, size_t size, size_t len, Number value) {
+	char digits[sizeof(Number) * 3];
+	size_t count = 0;
+	do {
+		digits[count ++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+
+	while (count > 0) {
+		-- count;
+		if (len < size) {
+			buf[len] = digits[count];
+		}
+		++ len;
+	}
+	return len;
+}
+
+size_t encode_byte(unsigned char *buf, size_t size, size_t len, unsigned char byte) {
+	if (len < size) {
+		buf[len] = byte;
+	}
+	return len + 1;
+}
+
+// Renders expr like expr_fprint() into buf, but without recursion and without
+// any stdio calls. Works like snprintf(): at most size bytes are written
+// (including the terminating '\0') and the length of the whole text is
+// returned.
+size_t expr_format(char *buf, size_t size, const Expr *expr) {
+	FormatItem stack[EXPR_MAX_DEPTH * 6 + 1];
+	size_t top = 0;
+	size_t len = 0;
+
+	stack[top ++] = (FormatItem){ .expr = expr, .text = NULL };
+
+	while (top > 0) {
+		const FormatItem item = stack[-- top];
+
+		if (item.text) {
+			len = format_text(buf, size, len, item.text);
+			continue;
+		}
+
+		const Expr *node = item.expr;
+		if (node->op == OpVal) {
+			len = format_number(buf, size, len, node->value);
+			continue;
+		}
+
+		if (top + 7 > sizeof(stack) / sizeof(stack[0])) {
+			panicf("expression nested too deeply");
+		}
+
+		// op equals to it's precedence
+		const bool lparen = node->op > node->u.e.left->op;
+		const bool rparen = needs_rparen(node->op, node->u.e.right->op);
+		const char *optext =
+			node->op == OpAdd ? " + " :
+			node->op == OpSub ? " - " :
+			node->op == OpMul ? " * " : " / ";
+
+		// pushed in reverse order
+		if (rparen) {
+			stack[top ++] = (FormatItem){ .expr = NULL, .text = ")" };
+		}
+		stack[top ++] = (FormatItem){ .expr = node->u.e.right, .text = NULL };
+		if (rparen) {
+			stack[top ++] = (FormatItem){ .expr = NULL, .text = "(" };
+		}
+		stack[top ++] = (FormatItem){ .expr = NULL, .text = optext };
+		if (lparen) {
+			stack[top ++] = (FormatItem){ .expr = NULL, .text = ")" };
+		}
+		stack[top ++] = (FormatItem){ .expr = node->u.e.left, .text = NULL };
+		if (lparen) {
+			stack[top ++] = (FormatItem){ .expr = NULL, .text = "(" };
+		}
+	}
+
+	if (size > 0) {
+		buf[len < size ? len : size - 1] = '\0';
+	}
+
+	return len;
+}
+
+// Encodes expr in reverse polish notation: a value is the byte OpVal followed
+// by the value as unsigned LEB128, an operation is the byte of its Op. Works
+// like expr_format(), but nothing is NUL terminated.
+size_t expr_encode(unsigned char *buf, size_t size, const Expr *expr) {
+	EncodeItem stack[EXPR_MAX_DEPTH * 2 + 1];
+	size_t top = 0;
+	size_t len = 0;
+
+	stack[top ++] = (EncodeItem){ .expr = expr, .children_done = false };
+
+	while (top > 0) {
+		const EncodeItem item = stack[-- top];
+		const Expr *node = item.expr;
+
+		if (node->op == OpVal) {
+			unsigned char varint[EXPR_VARINT_MAX_SIZE];
+			const size_t varint_len = expr_encode_varint(varint, node->value);
+			len = encode_byte(buf, size, len, OpVal);
+			for (size_t index = 0; index < varint_len; ++ index) {
+				len = encode_byte(buf, size, len, varint[index]);
+			}
+		}
+		else if (item.children_done) {
+			len = encode_byte(buf, size, len, (unsigned char)node->op);
+		}
+		else {
+			if (top + 3 > sizeof(stack) / sizeof(stack[0])) {
+				panicf("expression nested too deeply");
+			}
+			stack[top ++] = (EncodeItem){ .expr = node, .children_done = true };
+			stack[top ++] = (EncodeItem){ .expr = node->u.e.right, .children_done = false };
+			stack[top ++] = (EncodeItem){ .expr = node->u.e.left, .children_done = false };
+		}
+	}
+
+	return len;
+}
+
+size_t expr_encode_varint(unsigned char *buf, uint64_t value) {
+	size_t len = 0;
+	while (value >= 0x80) {
+		buf[len ++] = (unsigned char)(0x80 | (value & 0x7f));
+		value >>= 7;
+	}
+	buf[len ++] = (unsigned char)value;
+	return len;
+}
+
+#ifdef DEBUG
 void expr_fprint_op(FILE *stream, char op, const Expr *expr) {
 	// op equals to it's precedence
 	const int p = expr->op;
 	const int lp = expr->u.e.left->op;
-	const int rp = expr->u.e.right->op;
+	const bool rparen = needs_rparen(expr->op, expr->u.e.right->op);
 
 	if (p > lp) {
-		if (p > rp) {
+		if (rparen) {
 			fputc('(', stream);
 			expr_fprint(stream, expr->u.e.left);
 			fputc(')', stream);
 
-			printf(" %c ", op);
+			fprintf(stream, " %c ", op);
 
 			fputc('(', stream);
 			expr_fprint(stream, expr->u.e.right);
@@ -159,16 +410,16 @@ void expr_fprint_op(FILE *stream, char op, const Expr *expr) {
 			expr_fprint(stream, expr->u.e.left);
 			fputc(')', stream);
 
-			printf(" %c ", op);
+			fprintf(stream, " %c ", op);
 
 			expr_fprint(stream, expr->u.e.right);
 		}
 	}
 	else {
-		if (p > rp) {
+		if (rparen) {
 			expr_fprint(stream, expr->u.e.left);
 
-			printf(" %c ", op);
+			fprintf(stream, " %c ", op);
 
 			fputc('(', stream);
 			expr_fprint(stream, expr->u.e.right);
@@ -177,14 +428,13 @@ void expr_fprint_op(FILE *stream, char op, const Expr *expr) {
 		else {
 			expr_fprint(stream, expr->u.e.left);
 
-			printf(" %c ", op);
+			fprintf(stream, " %c ", op);
 
 			expr_fprint(stream, expr->u.e.right);
 		}
 	}
 }
 
-#ifdef DEBUG
 void expr_fprint(FILE *stream, const Expr *expr) {
 	fprintf(stream, "(0x%zx)(", (uintptr_t)expr);
 	switch (expr->op) {
@@ -198,12 +448,20 @@ void expr_fprint(FILE *stream, const Expr *expr) {
 }
 #else
 void expr_fprint(FILE *stream, const Expr *expr) {
-	switch (expr->op) {
-		case OpAdd: expr_fprint_op(stream, '+', expr); break;
-		case OpSub: expr_fprint_op(stream, '-', expr); break;
-		case OpMul: expr_fprint_op(stream, '*', expr); break;
-		case OpDiv: expr_fprint_op(stream, '/', expr); break;
-		case OpVal: fprintf(stream, PRIN, expr->value); break;
+	char buf[1024];
+	const size_t len = expr_format(buf, sizeof(buf), expr);
+
+	if (len < sizeof(buf)) {
+		fwrite(buf, 1, len, stream);
+	}
+	else {
+		char *bigbuf = malloc(len + 1);
+		if (!bigbuf) {
+			panice("allocating expression text buffer");
+		}
+		expr_format(bigbuf, len + 1, expr);
+		fwrite(bigbuf, 1, len, stream);
+		free(bigbuf);
 	}
 }
 #endif
@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,8 +21,10 @@ typedef enum OpE {
 
 typedef unsigned long Number;
 typedef size_t NumberSet;
+typedef uint64_t Hash;
 
 #define PRIN "%lu"
+#define NUMBER_MAX ((Number)-1)
 
 typedef struct ExprS {
 	Op op;
@@ -35,13 +38,33 @@ typedef struct ExprS {
 	Number value;
 	NumberSet used;
 	size_t generation;
+	// Signature of the canonical form. For chains of additions/subtractions
+	// and of multiplications/divisions this is the sum of the hashes of the
+	// chain's terms, with subtracted terms and divisors hashed differently, so
+	// it doesn't depend on how the chain is nested or ordered. Use expr_hash()
+	// to compare expressions.
+	Hash canon;
 } Expr;
 
 Expr *new_val(Number value, size_t index, size_t generation);
 Expr *new_expr(Op op, const Expr *left, const Expr *right, size_t generation);
 
-bool expr_equals(const Expr *left, const Expr *right);
+Number op_apply(Op op, Number left, Number right);
+bool op_checked(Op op, Number left, Number right, Number *result);
+Hash expr_canon(Op op, const Expr *left, const Expr *right);
+Hash expr_hash(const Expr *expr);
+Hash expr_canon_hash(Op op, Hash canon);
+
 void expr_fprint(FILE *stream, const Expr *expr);
+size_t expr_format(char *buf, size_t size, const Expr *expr);
+size_t expr_encode(unsigned char *buf, size_t size, const Expr *expr);
+
+// maximum length of an unsigned LEB128 encoded 64 bit number
+#define EXPR_VARINT_MAX_SIZE 10
+
+// Writes value as unsigned LEB128 to buf, which needs room for
+// EXPR_VARINT_MAX_SIZE bytes. Returns the number of bytes written.
+size_t expr_encode_varint(unsigned char *buf, uint64_t value);
 
 bool is_normalized_add(const Expr *left, const Expr *right);
 bool is_normalized_sub(const Expr *left, const Expr *right);
@@ -3,44 +3,113 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
-void exprbuf_add(ExprBuf *buf, Expr *expr) {
-	if (buf->size == buf->capacity) {
-		if (SIZE_MAX / 2 < buf->capacity) {
-			panicf("integer overflow");
+static void exprbuf_grow(ExprBuf *buf);
+
+void exprbuf_grow(ExprBuf *buf) {
+	if (buf->block_count == 1 && buf->capacity < EXPRBUF_BLOCK_SIZE) {
+		// only the first block is ever resized and it is at most one block big
+		const size_t capacity = buf->capacity * 2 < EXPRBUF_BLOCK_SIZE ?
+			buf->capacity * 2 : EXPRBUF_BLOCK_SIZE;
+		Expr **block = realloc(buf->blocks[0], capacity * sizeof(Expr*));
+		if (!block) {
+			panice("resizing expression buffer block");
 		}
-		const size_t capacity = buf->capacity == 0 ? EXPRBUF_INIT_CAPACITY : buf->capacity * 2;
-		buf->buf = realloc(buf->buf, capacity * sizeof(Expr));
+		buf->blocks[0] = block;
 		buf->capacity = capacity;
-		if (!buf->buf) {
-			panice("resizing expression buffer");
+		return;
+	}
+
+	if (buf->block_count == buf->block_capacity) {
+		if (SIZE_MAX / 2 / sizeof(Expr**) < buf->block_capacity) {
+			panicf("integer overflow");
 		}
+		const size_t block_capacity = buf->block_capacity == 0 ? 1 : buf->block_capacity * 2;
+		Expr ***blocks = realloc(buf->blocks, block_capacity * sizeof(Expr**));
+		if (!blocks) {
+			panice("resizing expression buffer block list");
+		}
+		buf->blocks = blocks;
+		buf->block_capacity = block_capacity;
+	}
+
+	const size_t block_size = buf->block_count == 0 ? EXPRBUF_INIT_CAPACITY : EXPRBUF_BLOCK_SIZE;
+	Expr **block = malloc(block_size * sizeof(Expr*));
+	if (!block) {
+		panice("allocating expression buffer block");
+	}
+
+	buf->blocks[buf->block_count] = block;
+	buf->block_count ++;
+	buf->capacity += block_size;
+}
+
+void exprbuf_add(ExprBuf *buf, Expr *expr) {
+	if (buf->size == buf->capacity) {
+		exprbuf_grow(buf);
 	}
 
-	buf->buf[buf->size] = expr;
+	buf->blocks[buf->size >> EXPRBUF_BLOCK_SHIFT][buf->size & EXPRBUF_BLOCK_MASK] = expr;
 	buf->size ++;
 }
 
-bool exprbuf_contains(const ExprBuf *buf, const Expr *expr) {
-	for (size_t index = 0; index < buf->size; ++ index) {
-		const Expr *other = buf->buf[index];
-		if (expr_equals(expr, other)) {
-			return true;
+void exprbuf_append(ExprBuf *buf, const ExprBuf *other) {
+	size_t index = 0;
+	while (index < other->size) {
+		if (buf->size == buf->capacity) {
+			exprbuf_grow(buf);
+		}
+
+		// copy the longest run that neither crosses a block boundary of the
+		// source nor of the destination buffer
+		const size_t src_offset = index & EXPRBUF_BLOCK_MASK;
+		const size_t dest_offset = buf->size & EXPRBUF_BLOCK_MASK;
+		size_t count = other->size - index;
+		if (count > EXPRBUF_BLOCK_SIZE - src_offset) {
+			count = EXPRBUF_BLOCK_SIZE - src_offset;
+		}
+		if (count > buf->capacity - buf->size) {
+			count = buf->capacity - buf->size;
+		}
+		if (count > EXPRBUF_BLOCK_SIZE - dest_offset) {
+			count = EXPRBUF_BLOCK_SIZE - dest_offset;
 		}
+
+		memcpy(
+			buf->blocks[buf->size >> EXPRBUF_BLOCK_SHIFT] + dest_offset,
+			other->blocks[index >> EXPRBUF_BLOCK_SHIFT] + src_offset,
+			count * sizeof(Expr*));
+
+		buf->size += count;
+		index += count;
 	}
-	return false;
+}
+
+void exprbuf_clear(ExprBuf *buf) {
+	// keeps the allocated blocks for reuse
+	buf->size = 0;
 }
 
 void exprbuf_free_buf(ExprBuf *buf) {
-	free(buf->buf);
-	buf->buf      = NULL;
-	buf->size     = 0;
-	buf->capacity = 0;
+	for (size_t block_index = 0; block_index < buf->block_count; ++ block_index) {
+		free(buf->blocks[block_index]);
+	}
+	free(buf->blocks);
+	buf->blocks         = NULL;
+	buf->block_count    = 0;
+	buf->block_capacity = 0;
+	buf->size           = 0;
+	buf->capacity       = 0;
 }
 
 void exprbuf_free_items(ExprBuf *buf) {
-	for (size_t index = 0; index < buf->size; ++ index) {
-		free(buf->buf[index]);
+	for (size_t block_index = 0; block_index < buf->block_count; ++ block_index) {
+		Expr *const *const block = buf->blocks[block_index];
+		const size_t block_size = exprbuf_block_size(buf, block_index);
+		for (size_t index = 0; index < block_size; ++ index) {
+			free(block[index]);
+		}
 	}
 	exprbuf_free_buf(buf);
 }
@@ -7,20 +7,50 @@
 extern "C" {
 #endif
 
+// ExprBuf is a segmented vector: expressions are stored in fixed size blocks
+// that are never moved once they are full, so growing the buffer never copies
+// already stored pointers and never needs the old and the new storage at the
+// same time. Only the first block starts out small and is grown up to the full
+// block size, so the many tiny per-segment buffers stay cheap.
 #define EXPRBUF_INIT_CAPACITY 64
-#define EXPRBUF_INIT { .buf = NULL, .size = 0, .capacity = 0 }
+#define EXPRBUF_BLOCK_SHIFT   12
+#define EXPRBUF_BLOCK_SIZE    ((size_t)1 << EXPRBUF_BLOCK_SHIFT)
+#define EXPRBUF_BLOCK_MASK    (EXPRBUF_BLOCK_SIZE - 1)
+#define EXPRBUF_INIT { .blocks = NULL, .block_count = 0, .block_capacity = 0, .size = 0, .capacity = 0 }
 
 typedef struct ExprBufS {
-	Expr **buf;
+	Expr ***blocks;
+	size_t block_count;
+	size_t block_capacity;
 	size_t size;
 	size_t capacity;
 } ExprBuf;
 
 void exprbuf_add(ExprBuf *buf, Expr *expr);
-bool exprbuf_contains(const ExprBuf *buf, const Expr *expr);
+void exprbuf_append(ExprBuf *buf, const ExprBuf *other);
+void exprbuf_clear(ExprBuf *buf);
 void exprbuf_free_buf(ExprBuf *buf);
 void exprbuf_free_items(ExprBuf *buf);
 
+static inline Expr *exprbuf_get(const ExprBuf *buf, size_t index) {
+	return buf->blocks[index >> EXPRBUF_BLOCK_SHIFT][index & EXPRBUF_BLOCK_MASK];
+}
+
+static inline void exprbuf_set(ExprBuf *buf, size_t index, Expr *expr) {
+	buf->blocks[index >> EXPRBUF_BLOCK_SHIFT][index & EXPRBUF_BLOCK_MASK] = expr;
+}
+
+// Number of used entries in the block at block_index. Use together with
+// buf->blocks[block_index] to iterate a buffer block by block.
+static inline size_t exprbuf_block_size(const ExprBuf *buf, size_t block_index) {
+	const size_t offset = block_index << EXPRBUF_BLOCK_SHIFT;
+	if (offset >= buf->size) {
+		return 0;
+	}
+	const size_t rest = buf->size - offset;
+	return rest < EXPRBUF_BLOCK_SIZE ? rest : EXPRBUF_BLOCK_SIZE;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,15 +11,41 @@
 #endif
 
 #include "numbers.h"
+#include "reach.h"
+#include "server.h"
 #include "panic.h"
 
+// stdout is fully buffered with a buffer of this size
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
 typedef struct Context {
 	size_t count;
+	bool binary;
+	bool show_value;
+	// scratch buffer a solution is rendered into before it is written out
+	char *buf;
+	size_t size;
 } Context;
 
+typedef struct OptionsS {
+	bool reach;
+	bool binary;
+	Number reach_cap;
+	const char *server_path;
+	size_t cache_size;
+	size_t max_count;
+	bool stats;
+	NumbersOptions solver;
+} Options;
+
 static Number parse_number(const char *str, const char *errmsg);
 static void callback(void *arg, const Expr *expr);
+static void reserve_buf(Context *ctx, size_t size);
+static void write_text(Context *ctx, const Expr *expr);
+static void write_binary(Context *ctx, const Expr *expr);
+static int parse_options(int argc, char *argv[], Options *options);
 static int compare_number(const void *lptr, const void *rptr);
+static void print_stats(const NumbersStats *stats);
 
 #ifdef _SC_NPROCESSORS_ONLN
 static size_t get_cpu_count();
@@ -34,21 +60,197 @@ Number parse_number(const char *str, const char *errmsg) {
 	return size;
 }
 
+void reserve_buf(Context *ctx, size_t size) {
+	if (size > ctx->size) {
+		char *buf = realloc(ctx->buf, size);
+		if (!buf) {
+			panice("resizing output buffer");
+		}
+		ctx->buf = buf;
+		ctx->size = size;
+	}
+}
+
+// Renders the whole line into the scratch buffer so it is written with one
+// call.
+void write_text(Context *ctx, const Expr *expr) {
+	// prefix and suffix are at most a few numbers long
+	const size_t extra = 64;
+	const int prefix = snprintf(ctx->buf, ctx->size, "%3zu: ", ctx->count);
+	if (prefix < 0) {
+		panice("formatting solution");
+	}
+
+	size_t len = (size_t)prefix + expr_format(ctx->buf + prefix, ctx->size - (size_t)prefix, expr);
+	if (len + extra > ctx->size) {
+		reserve_buf(ctx, len + extra);
+		expr_format(ctx->buf + prefix, ctx->size - (size_t)prefix, expr);
+	}
+
+	if (ctx->show_value) {
+		const int suffix = snprintf(ctx->buf + len, ctx->size - len, " = " PRIN, expr->value);
+		if (suffix < 0) {
+			panice("formatting solution");
+		}
+		len += (size_t)suffix;
+	}
+
+	ctx->buf[len ++] = '\n';
+	fwrite(ctx->buf, 1, len, stdout);
+}
+
+// Writes the solution as the size of its encoding (unsigned LEB128) followed
+// by the encoding itself (see expr_encode()).
+void write_binary(Context *ctx, const Expr *expr) {
+	unsigned char *buf = (unsigned char*)ctx->buf + EXPR_VARINT_MAX_SIZE;
+	size_t len = expr_encode(buf, ctx->size - EXPR_VARINT_MAX_SIZE, expr);
+	if (len + EXPR_VARINT_MAX_SIZE > ctx->size) {
+		reserve_buf(ctx, len + EXPR_VARINT_MAX_SIZE);
+		buf = (unsigned char*)ctx->buf + EXPR_VARINT_MAX_SIZE;
+		expr_encode(buf, len, expr);
+	}
+
+	unsigned char header[EXPR_VARINT_MAX_SIZE];
+	const size_t header_len = expr_encode_varint(header, len);
+
+	// put the header right in front of the encoding
+	unsigned char *record = buf - header_len;
+	memcpy(record, header, header_len);
+	fwrite(record, 1, header_len + len, stdout);
+}
+
 void callback(void *arg, const Expr *expr) {
 	Context *ctx = (Context*)arg;
-	printf("%3zu: ", ctx->count);
-	expr_fprint(stdout, expr);
-	putchar('\n');
+	if (ctx->binary) {
+		write_binary(ctx, expr);
+	}
+	else {
+		write_text(ctx, expr);
+	}
 
 	++ ctx->count;
 }
 
+// Parses leading --options and returns the index of the first positional
+// argument.
+int parse_options(int argc, char *argv[], Options *options) {
+	int argind = 1;
+	for (; argind < argc; ++ argind) {
+		const char *arg = argv[argind];
+		if (strncmp(arg, "--", 2) != 0) {
+			break;
+		}
+
+		if (strcmp(arg, "--") == 0) {
+			++ argind;
+			break;
+		}
+		else if (strcmp(arg, "--reach") == 0) {
+			options->reach = true;
+			options->reach_cap = 0;
+		}
+		else if (strncmp(arg, "--reach=", 8) == 0) {
+			options->reach = true;
+			options->reach_cap = parse_number(arg + 8, "value cap is not a number or out of range");
+			if (options->reach_cap == 0) {
+				panicf("value cap has to be >= 1");
+			}
+		}
+		else if (strncmp(arg, "--server=", 9) == 0) {
+			options->server_path = arg + 9;
+			if (!*options->server_path) {
+				panicf("socket path may not be empty");
+			}
+		}
+		else if (strncmp(arg, "--cache=", 8) == 0) {
+			options->cache_size = parse_number(arg + 8, "cache size is not a number or out of range");
+		}
+		else if (strncmp(arg, "--max-count=", 12) == 0) {
+			options->max_count = parse_number(arg + 12, "maximum count is not a number or out of range");
+		}
+		else if (strcmp(arg, "--binary") == 0) {
+			options->binary = true;
+		}
+		else if (strcmp(arg, "--shortest") == 0) {
+			options->solver.shortest = true;
+		}
+		else if (strncmp(arg, "--max-size=", 11) == 0) {
+			options->solver.max_size = parse_number(arg + 11, "maximum size is not a number or out of range");
+			if (options->solver.max_size == 0) {
+				panicf("maximum size has to be >= 1");
+			}
+		}
+		else if (strncmp(arg, "--checkpoint=", 13) == 0) {
+			options->solver.checkpoint = arg + 13;
+			if (!*options->solver.checkpoint) {
+				panicf("checkpoint path may not be empty");
+			}
+		}
+		else if (strcmp(arg, "--stats") == 0) {
+			options->stats = true;
+		}
+		else if (strncmp(arg, "--bound=", 8) == 0) {
+			const char *value = arg + 8;
+			if (strcmp(value, "auto") == 0) {
+				options->solver.bound_mode = BoundAuto;
+			}
+			else if (strcmp(value, "none") == 0) {
+				options->solver.bound_mode = BoundNone;
+			}
+			else {
+				options->solver.bound_mode = BoundFixed;
+				options->solver.bound = parse_number(value, "bound is not a number or out of range");
+			}
+		}
+		else if (strncmp(arg, "--affinity=", 11) == 0) {
+			const char *value = arg + 11;
+			if (strcmp(value, "compact") == 0) {
+				options->solver.affinity = AffinityCompact;
+			}
+			else if (strcmp(value, "scatter") == 0) {
+				options->solver.affinity = AffinityScatter;
+			}
+			else {
+				const size_t cpu_count = affinity_parse_list(value, NULL, 0);
+				if (cpu_count == 0) {
+					panicf("illegal CPU list: %s", value);
+				}
+				size_t *cpus = calloc(cpu_count, sizeof(size_t));
+				if (!cpus) {
+					panice("allocating CPU list");
+				}
+				affinity_parse_list(value, cpus, cpu_count);
+				free((size_t*)options->solver.cpus);
+				options->solver.affinity = AffinityList;
+				options->solver.cpus = cpus;
+				options->solver.cpu_count = cpu_count;
+			}
+		}
+		else {
+			panicf("unknown option: %s", arg);
+		}
+	}
+	return argind;
+}
+
 int compare_number(const void *lptr, const void *rptr) {
 	Number l = *(Number*)lptr;
 	Number r = *(Number*)rptr;
 	return l < r ? -1 : r < l ? 1 : 0;
 }
 
+void print_stats(const NumbersStats *stats) {
+	fprintf(stderr,
+		"generations: %zu\n"
+		"expressions: %zu\n"
+		"solutions:   %zu\n"
+		"duplicates:  %zu\n"
+		"pruned:      %zu\n"
+		"overflows:   %zu\n",
+		stats->generations, stats->exprs, stats->solutions,
+		stats->duplicates, stats->pruned, stats->overflows);
+}
+
 #ifdef _SC_NPROCESSORS_ONLN
 #define HAS_GET_CPU_COUNT
 size_t get_cpu_count() {
@@ -61,7 +263,25 @@ size_t get_cpu_count() {
 #endif
 
 int main(int argc, char* argv[]) {
-	if (argc < 3) {
+	Options options = {
+		.reach = false,
+		.binary = false,
+		.reach_cap = 0,
+		.server_path = NULL,
+		.cache_size = SERVER_DEFAULT_CACHE_SIZE,
+		.max_count = SERVER_DEFAULT_MAX_COUNT,
+		.stats = false,
+		.solver = NUMBERS_OPTIONS_INIT
+	};
+	const int argind = parse_options(argc, argv, &options);
+
+	if (setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE) != 0) {
+		panice("setting output buffer");
+	}
+	argc -= argind - 1;
+	argv += argind - 1;
+
+	if (argc < (options.server_path ? 2 : 3)) {
 		fprintf(stderr, "not enough arguments\n");
 		return 1;
 	}
@@ -73,13 +293,28 @@ int main(int argc, char* argv[]) {
 #endif
 		parse_number(argv[1], "number of tasks is not a number or out of range");
 
-	const Number target = parse_number(argv[2], "target is not a number or out of range");
-	const size_t count = (size_t)argc - 3;
-
 	if (tasks == 0) {
 		panicf("number of tasks has to be >= 1");
 	}
 
+	if (options.server_path) {
+		if (options.reach || options.binary || options.stats || options.solver.shortest || options.solver.checkpoint) {
+			panicf("--reach, --binary, --stats, --shortest and --checkpoint can't be used with --server");
+		}
+
+		ServerOptions server_options = SERVER_OPTIONS_INIT;
+		server_options.solver = options.solver;
+		server_options.solver.tasks = tasks;
+		server_options.cache_size = options.cache_size;
+		server_options.max_count = options.max_count;
+		numbers_server(options.server_path, &server_options);
+		free((size_t*)options.solver.cpus);
+		return 0;
+	}
+
+	const Number target = parse_number(argv[2], "target is not a number or out of range");
+	const size_t count = (size_t)argc - 3;
+
 	if (count > sizeof(NumberSet) * 8) {
 		panicf("only up to %zu numbers supported", sizeof(NumberSet) * 8);
 	}
@@ -96,26 +331,58 @@ int main(int argc, char* argv[]) {
 
 	qsort(numbers, count, sizeof(Number), compare_number);
 
-	printf("tasks = %zu\n", tasks);
-	printf("target = " PRIN "\n", target);
-	if (count == 0) {
-		printf("numbers = [");
-	}
-	else {
-		printf("numbers = [" PRIN, numbers[0]);
-		for (size_t index = 1; index < count; ++ index) {
-			printf(", " PRIN, numbers[index]);
+	if (!options.binary) {
+		printf("tasks = %zu\n", tasks);
+		printf("target = " PRIN "\n", target);
+		if (count == 0) {
+			printf("numbers = [");
+		}
+		else {
+			printf("numbers = [" PRIN, numbers[0]);
+			for (size_t index = 1; index < count; ++ index) {
+				printf(", " PRIN, numbers[index]);
+			}
 		}
+		printf("]\n\nsolutions:\n");
 	}
-	printf("]\n\nsolutions:\n");
 
-	Context ctx = { .count = 1 };
-	numbers_solutions(tasks, target, numbers, count, callback, &ctx);
-	if (ctx.count == 1) {
-		puts("no solutions found");
+	Context ctx = {
+		.count = 1,
+		.binary = options.binary,
+		.show_value = options.reach,
+		.buf = NULL,
+		.size = 0
+	};
+	reserve_buf(&ctx, 4096);
+
+	if (options.reach) {
+		const Number cap = options.reach_cap != 0 ? options.reach_cap :
+			reach_default_cap(target, numbers, count);
+
+		if (!numbers_reach(cap, target, numbers, count, NULL, callback, &ctx) && !options.binary) {
+			// the one printed expression (if any) is the closest one
+			puts(ctx.count == 1 ? "no solutions found" : "(closest, no exact solution found)");
+		}
+	}
+	else {
+		NumbersStats stats = NUMBERS_STATS_INIT;
+		options.solver.tasks = tasks;
+		if (options.stats) {
+			options.solver.stats = &stats;
+		}
+		numbers_solutions_opts(&options.solver, target, numbers, count, callback, &ctx);
+		if (ctx.count == 1 && !options.binary) {
+			puts("no solutions found");
+		}
+		if (options.stats) {
+			fflush(stdout);
+			print_stats(&stats);
+		}
 	}
 
+	free(ctx.buf);
 	free(numbers);
+	free((size_t*)options.solver.cpus);
 
 	return 0;
 }
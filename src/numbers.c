@@ -1,5 +1,8 @@
 #include "numbers.h"
+#include "affinity.h"
 #include "exprbuf.h"
+#include "canonset.h"
+#include "checkpoint.h"
 #include "panic.h"
 
 #include <stdio.h>
@@ -7,116 +10,461 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <errno.h>
 #include <pthread.h>
 #include <semaphore.h>
 
-typedef struct ManagerS {
+// Marks expressions that were dropped by worker_insert(). Other workers may
+// still be reading the used field of such an expression at that time, so it
+// can only be freed later by the manager.
+#define GENERATION_DROPPED SIZE_MAX
+
+typedef enum WorkerTaskE {
+	// combine the expressions [lower, upper) with all others
+	TaskCombine,
+	// move the new expressions of the segments owned by the worker into them
+	TaskInsert,
+	TaskQuit
+} WorkerTask;
+
+struct WorkerS;
+
+struct NumbersPoolS {
+	// workers report finished tasks here
 	sem_t semaphore;
+	struct WorkerS *workers;
+	size_t tasks;
+};
+
+typedef struct ManagerS {
+	NumbersPool *pool;
+	const volatile bool *cancel;
+	// number of workers that got combination work in this generation
+	volatile size_t worker_count;
 	ExprBuf exprs;
 	ExprBuf *segments;
+	// canonical hashes of the expressions in each segment
+	CanonSet *canons;
 	NumberSet segment_count;
+	NumberSet full_usage;
+	Number target;
+	// upper bound for the values of the expressions in each segment
+	Number *bounds;
+	// maximum number of given numbers used in an expression, 0 for no limit
+	size_t max_size;
 	volatile size_t generation;
 } Manager;
 
+typedef struct RankedS {
+	const Expr *expr;
+	Number max_value;
+	// position in which the solution was found
+	size_t order;
+} Ranked;
+
 typedef struct WorkerS {
 	pthread_t thread;
 	volatile ExprBuf new_exprs;
+	volatile ExprBuf solutions;
+	volatile WorkerTask task;
 	volatile size_t lower;
 	volatile size_t upper;
+	size_t index;
+	NumbersStats stats;
 	sem_t semaphore;
+	NumbersPool *pool;
+	// the manager of the current solve
 	Manager *manager;
 } Worker;
 
-static void make_exprs(ExprBuf *exprs, const Expr *a, const Expr *b, const size_t generation);
-static void make_half_exprs(ExprBuf *exprs, const Expr *a, const Expr *b, const size_t generation);
+static void worker_make(Worker *worker, Op op, const Expr *left, const Expr *right, const size_t generation);
+static void make_exprs(Worker *worker, const Expr *a, const Expr *b, const size_t generation);
+static void make_half_exprs(Worker *worker, const Expr *a, const Expr *b, const size_t generation);
+static void worker_combine(Worker *worker);
+static void worker_insert(Worker *worker);
+static void run_workers(NumbersPool *pool, size_t worker_count);
+static bool is_cancelled(const Manager *manager);
+static void free_worker_exprs(Worker *worker);
+static Number mul_saturated(Number left, Number right);
+static void init_bounds(Manager *manager, const NumbersOptions *options, const Number numbers[], size_t count);
+static bool has_next_generation(const Manager *manager, size_t lower, size_t upper, size_t max_generation, bool shortest, size_t shortest_size);
+static size_t count_bits(NumberSet set);
+static Number max_value(const Expr *expr);
+static int compare_ranked(const void *lptr, const void *rptr);
+static void emit_shortest(const ExprBuf *solutions, size_t size, void (*callback)(void*, const Expr*), void *arg);
 static void *worker_proc(void *arg);
 
-void make_exprs(ExprBuf *exprs, const Expr *a, const Expr *b, const size_t generation) {
+// Creates a new expression and sorts it into the worker's solutions or new
+// expressions so the manager can append the latter in bulk. Expressions that
+// use all numbers but aren't the target can't be combined any further and
+// expressions that are equivalent to one stored in a previous generation would
+// only produce duplicates, so these aren't created at all.
+void worker_make(Worker *worker, Op op, const Expr *left, const Expr *right, const size_t generation) {
+	const Manager *manager = worker->manager;
+	const NumberSet used = left->used | right->used;
+	Number value;
+
+	if (!op_checked(op, left->value, right->value, &value)) {
+		++ worker->stats.overflows;
+	}
+	else if (value == manager->target) {
+		exprbuf_add((ExprBuf*)&worker->solutions, new_expr(op, left, right, generation));
+	}
+	else if (used != manager->full_usage) {
+		if (value > manager->bounds[used - 1]) {
+			++ worker->stats.pruned;
+			return;
+		}
+
+		const Hash hash = expr_canon_hash(op, expr_canon(op, left, right));
+		if (!canonset_contains(&manager->canons[used - 1], hash)) {
+			exprbuf_add((ExprBuf*)&worker->new_exprs, new_expr(op, left, right, generation));
+		}
+		else {
+			++ worker->stats.duplicates;
+		}
+	}
+}
+
+void make_exprs(Worker *worker, const Expr *a, const Expr *b, const size_t generation) {
 	const Number avalue = a->value;
 	const Number bvalue = b->value;
 
 	if (is_normalized_add(a, b)) {
-		exprbuf_add(exprs, new_expr(OpAdd, a, b, generation));
+		worker_make(worker, OpAdd, a, b, generation);
 	}
 	else if (is_normalized_add(b, a)) {
-		exprbuf_add(exprs, new_expr(OpAdd, b, a, generation));
+		worker_make(worker, OpAdd, b, a, generation);
 	}
 
 	if (avalue != 1 && bvalue != 1) {
 		if (is_normalized_mul(a, b)) {
-			exprbuf_add(exprs, new_expr(OpMul, a, b, generation));
+			worker_make(worker, OpMul, a, b, generation);
 		}
 		else if (is_normalized_mul(b, a)) {
-			exprbuf_add(exprs, new_expr(OpMul, b, a, generation));
+			worker_make(worker, OpMul, b, a, generation);
 		}
 	}
 
 	if (avalue > bvalue) {
 		if (is_normalized_sub(a, b) && avalue - bvalue != bvalue) {
-			exprbuf_add(exprs, new_expr(OpSub, a, b, generation));
+			worker_make(worker, OpSub, a, b, generation);
 		}
 
 		if (bvalue != 1 && (avalue % bvalue) == 0 && avalue / bvalue != bvalue && is_normalized_div(a, b)) {
-			exprbuf_add(exprs, new_expr(OpDiv, a, b, generation));
+			worker_make(worker, OpDiv, a, b, generation);
 		}
 	}
 	else if (bvalue > avalue) {
 		if (is_normalized_sub(b, a) && bvalue - avalue != avalue) {
-			exprbuf_add(exprs, new_expr(OpSub, b, a, generation));
+			worker_make(worker, OpSub, b, a, generation);
 		}
 
 		if (avalue != 1 && (bvalue % avalue) == 0 && bvalue / avalue != avalue && is_normalized_div(b, a)) {
-			exprbuf_add(exprs, new_expr(OpDiv, b, a, generation));
+			worker_make(worker, OpDiv, b, a, generation);
 		}
 	}
 	else if (bvalue != 1) {
 		if (is_normalized_div(a, b)) {
-			exprbuf_add(exprs, new_expr(OpDiv, a, b, generation));
+			worker_make(worker, OpDiv, a, b, generation);
 		}
 		else if (is_normalized_div(b, a)) {
-			exprbuf_add(exprs, new_expr(OpDiv, b, a, generation));
+			worker_make(worker, OpDiv, b, a, generation);
 		}
 	}
 }
 
-void make_half_exprs(ExprBuf *exprs, const Expr *a, const Expr *b, const size_t generation) {
+void make_half_exprs(Worker *worker, const Expr *a, const Expr *b, const size_t generation) {
 	const Number avalue = a->value;
 	const Number bvalue = b->value;
 
 	if (is_normalized_add(a, b)) {
-		exprbuf_add(exprs, new_expr(OpAdd, a, b, generation));
+		worker_make(worker, OpAdd, a, b, generation);
 	}
 
 	if (avalue != 1 && bvalue != 1) {
 		if (is_normalized_mul(a, b)) {
-			exprbuf_add(exprs, new_expr(OpMul, a, b, generation));
+			worker_make(worker, OpMul, a, b, generation);
 		}
 	}
 
 	if (avalue > bvalue) {
 		if (is_normalized_sub(a, b) && avalue - bvalue != bvalue) {
-			exprbuf_add(exprs, new_expr(OpSub, a, b, generation));
+			worker_make(worker, OpSub, a, b, generation);
 		}
 
 		if (bvalue != 1 && (avalue % bvalue) == 0 && avalue / bvalue != bvalue && is_normalized_div(a, b)) {
-			exprbuf_add(exprs, new_expr(OpDiv, a, b, generation));
+			worker_make(worker, OpDiv, a, b, generation);
 		}
 	}
 	else if (avalue == bvalue && bvalue != 1) {
 		if (is_normalized_div(a, b)) {
-			exprbuf_add(exprs, new_expr(OpDiv, a, b, generation));
+			worker_make(worker, OpDiv, a, b, generation);
 		}
 	}
 }
 
-void numbers_solutions(
-	const size_t tasks, const Number target, const Number numbers[],
-	const size_t count, void (*callback)(void*, const Expr*), void *arg) {
+// Posts the already assigned tasks to the first worker_count workers and waits
+// for all of them to finish.
+void run_workers(NumbersPool *pool, size_t worker_count) {
+	for (size_t index = 0; index < worker_count; ++ index) {
+		if (sem_post(&pool->workers[index].semaphore) != 0) {
+			panice("sending work to worker thread");
+		}
+	}
+
+	for (size_t finished = 0; finished < worker_count; ++ finished) {
+		if (sem_wait(&pool->semaphore) != 0) {
+			panice("waiting for worker thread");
+		}
+	}
+}
+
+Number mul_saturated(Number left, Number right) {
+	Number result;
+	return op_checked(OpMul, left, right, &result) ? result : NUMBER_MAX;
+}
+
+// Any value that can be built from a set of numbers R is at most
+// F(R) - 1 with F(R) = (r1 + 1) * (r2 + 1) * ... and using numbers from R an
+// expression with the value v can at best be reduced to a value t with
+// v + 1 <= (t + 1) * F(R) (by subtracting or dividing). So expressions with
+// values above (target + 1) * F(unused numbers) - 1 can never be part of a
+// solution and are pruned without losing any solutions. A user given bound
+// further limits this.
+void init_bounds(Manager *manager, const NumbersOptions *options, const Number numbers[], size_t count) {
+	const NumberSet segment_count = manager->segment_count;
+	Number *bounds = manager->bounds;
+
+	if (options->bound_mode == BoundNone) {
+		for (NumberSet index = 0; index < segment_count; ++ index) {
+			bounds[index] = NUMBER_MAX;
+		}
+		return;
+	}
+
+	const Number target_factor = manager->target == NUMBER_MAX ? NUMBER_MAX : manager->target + 1;
+	for (NumberSet used = 1; used <= segment_count; ++ used) {
+		const NumberSet unused = manager->full_usage & ~used;
+		Number factor = 1;
+		for (size_t index = 0; index < count; ++ index) {
+			if (unused & ((NumberSet)1 << index)) {
+				factor = mul_saturated(factor, numbers[index] == NUMBER_MAX ? NUMBER_MAX : numbers[index] + 1);
+			}
+		}
+		Number bound = mul_saturated(target_factor, factor);
+		if (bound != NUMBER_MAX) {
+			-- bound;
+		}
+		if (options->bound_mode == BoundFixed && options->bound < bound) {
+			bound = options->bound;
+		}
+		bounds[used - 1] = bound;
+	}
+}
+
+// Whether the previous generation made new expressions and another one can
+// still find (shorter) solutions.
+bool has_next_generation(const Manager *manager, size_t lower, size_t upper, size_t max_generation, bool shortest, size_t shortest_size) {
+	return lower < upper && manager->generation < max_generation &&
+	       !(shortest && shortest_size <= manager->generation + 1);
+}
+
+size_t count_bits(NumberSet set) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (size_t)__builtin_popcountl(set);
+#else
+	size_t count = 0;
+	for (; set; set &= set - 1) {
+		++ count;
+	}
+	return count;
+#endif
+}
+
+// biggest value of any sub-expression
+Number max_value(const Expr *expr) {
+	if (expr->op == OpVal) {
+		return expr->value;
+	}
+	const Number left  = max_value(expr->u.e.left);
+	const Number right = max_value(expr->u.e.right);
+	const Number max = left > right ? left : right;
+	return expr->value > max ? expr->value : max;
+}
+
+// Simpler solutions first: by nesting depth, then largest intermediate value,
+// then discovery order. All of them use the same number of numbers.
+int compare_ranked(const void *lptr, const void *rptr) {
+	const Ranked *l = (const Ranked*)lptr;
+	const Ranked *r = (const Ranked*)rptr;
+
+	if (l->expr->generation != r->expr->generation) {
+		return l->expr->generation < r->expr->generation ? -1 : 1;
+	}
+	if (l->max_value != r->max_value) {
+		return l->max_value < r->max_value ? -1 : 1;
+	}
+	return l->order < r->order ? -1 : l->order > r->order ? 1 : 0;
+}
+
+// Passes all solutions that use size numbers to callback, simplest first.
+void emit_shortest(const ExprBuf *solutions, size_t size, void (*callback)(void*, const Expr*), void *arg) {
+	Ranked *ranked = calloc(solutions->size == 0 ? 1 : solutions->size, sizeof(Ranked));
+	if (!ranked) {
+		panice("allocating solutions array");
+	}
+
+	size_t count = 0;
+	for (size_t index = 0; index < solutions->size; ++ index) {
+		const Expr *expr = exprbuf_get(solutions, index);
+		if (count_bits(expr->used) == size) {
+			ranked[count].expr = expr;
+			ranked[count].max_value = max_value(expr);
+			ranked[count].order = index;
+			++ count;
+		}
+	}
+
+	qsort(ranked, count, sizeof(Ranked), compare_ranked);
+
+	for (size_t index = 0; index < count; ++ index) {
+		callback(arg, ranked[index].expr);
+	}
+
+	free(ranked);
+}
+
+bool is_cancelled(const Manager *manager) {
+	return manager->cancel && *manager->cancel;
+}
+
+void free_worker_exprs(Worker *worker) {
+	exprbuf_free_items((ExprBuf*)&worker->solutions);
+	exprbuf_free_items((ExprBuf*)&worker->new_exprs);
+}
+
+NumbersPool *numbers_pool_new(const NumbersOptions *options) {
+	const size_t tasks = options->tasks;
 
 	if (tasks == 0) {
 		panicf("number of tasks has to be >= 1");
 	}
 
+	NumbersPool *pool = calloc(1, sizeof(NumbersPool));
+	if (!pool) {
+		panice("allocating worker pool");
+	}
+
+	if (sem_init(&pool->semaphore, 0, 0) != 0) {
+		panice("initializing pool semaphore");
+	}
+
+	Worker *workers = calloc(tasks, sizeof(Worker));
+	if (!workers) {
+		panice("allocating workers array");
+	}
+
+	pool->workers = workers;
+	pool->tasks = tasks;
+
+	for (size_t index = 0; index < tasks; ++ index) {
+		Worker *worker = &workers[index];
+		worker->pool = pool;
+		worker->index = index;
+
+		if (sem_init(&worker->semaphore, 0, 0) != 0) {
+			panice("initializing worker semaphore");
+		}
+	}
+
+	size_t *cpus = NULL;
+	if (options->affinity != AffinityNone) {
+		cpus = calloc(tasks, sizeof(size_t));
+		if (!cpus) {
+			panice("allocating CPU list");
+		}
+		affinity_plan(options->affinity, options->cpus, options->cpu_count, tasks, cpus);
+	}
+
+	// start up all worker threads
+	for (size_t index = 0; index < tasks; ++ index) {
+		Worker *worker = &workers[index];
+		pthread_attr_t attr;
+		int errnum = pthread_attr_init(&attr);
+		if (errnum != 0) {
+			panicf("initializing worker thread attributes: %s", strerror(errnum));
+		}
+
+		// A pinned worker starts out on its CPU, so everything it allocates
+		// (its output buffers and, via worker_insert(), the storage of the
+		// segments it owns) is first touched on that CPU's NUMA node.
+		if (cpus) {
+			affinity_set_attr(&attr, cpus[index]);
+		}
+
+		errnum = pthread_create(&worker->thread, &attr, &worker_proc, worker);
+		if (errnum != 0) {
+			panicf("starting worker therad: %s", strerror(errnum));
+		}
+
+		pthread_attr_destroy(&attr);
+	}
+
+	free(cpus);
+
+	return pool;
+}
+
+void numbers_pool_free(NumbersPool *pool) {
+	const size_t tasks = pool->tasks;
+	Worker *workers = pool->workers;
+
+	for (size_t index = 0; index < tasks; ++ index) {
+		Worker *worker = &workers[index];
+		worker->task = TaskQuit;
+		if (sem_post(&worker->semaphore) != 0) {
+			perror("signaling end to worker thread");
+		}
+	}
+
+	for (size_t index = 0; index < tasks; ++ index) {
+		Worker *worker = &workers[index];
+		const int errnum = pthread_join(worker->thread, NULL);
+		if (errnum != 0) {
+			fprintf(stderr, "wating for worker thread to end: %s\n", strerror(errnum));
+		}
+		if (sem_destroy(&worker->semaphore) != 0) {
+			perror("destroying worker semaphore");
+		}
+	}
+
+	free(workers);
+
+	if (sem_destroy(&pool->semaphore) != 0) {
+		perror("destroying pool semaphore");
+	}
+
+	free(pool);
+}
+
+size_t numbers_pool_tasks(const NumbersPool *pool) {
+	return pool->tasks;
+}
+
+void numbers_solutions(
+	const size_t tasks, const Number target, const Number numbers[],
+	const size_t count, void (*callback)(void*, const Expr*), void *arg) {
+
+	NumbersOptions options = NUMBERS_OPTIONS_INIT;
+	options.tasks = tasks;
+	numbers_solutions_opts(&options, target, numbers, count, callback, arg);
+}
+
+bool numbers_solutions_opts(
+	const NumbersOptions *options, const Number target, const Number numbers[],
+	const size_t count, void (*callback)(void*, const Expr*), void *arg) {
+
 	// Given numbers that already happen to be the target number shall not
 	// be added to the expression list for consitency (expressions that equal
 	// the target number aren't added to the expression list either - I don't
@@ -136,14 +484,29 @@ void numbers_solutions(
 		panicf("only up to %zu numbers supported", sizeof(NumberSet) * 8);
 	}
 
-	const NumberSet full_usage = ~(~0ul << non_target_count);
+	NumbersPool *pool = options->pool ? options->pool : numbers_pool_new(options);
+	Worker *workers = pool->workers;
+	const size_t tasks = pool->tasks;
+
+	const NumberSet full_usage = non_target_count == sizeof(NumberSet) * 8 ?
+		~(NumberSet)0 : ~(~(NumberSet)0 << non_target_count);
 	ExprBuf uniq_solutions = EXPRBUF_INIT;
+	CanonSet solution_keys = CANONSET_INIT;
 	Manager manager = {
+		.pool = pool,
+		.cancel = options->cancel,
+		.worker_count = 0,
 		.exprs = EXPRBUF_INIT,
 		// calloc zeroes the newly allocated memory, which is a proper
 		// initialization for ExprBuf
 		.segments = calloc(full_usage, sizeof(ExprBuf)),
+		// same for CanonSet
+		.canons = calloc(full_usage, sizeof(CanonSet)),
 		.segment_count = full_usage,
+		.full_usage = full_usage,
+		.target = target,
+		.bounds = calloc(full_usage, sizeof(Number)),
+		.max_size = options->max_size,
 		.generation = 0
 	};
 
@@ -151,22 +514,24 @@ void numbers_solutions(
 		panice("allocating segments array");
 	}
 
-	if (sem_init(&manager.semaphore, 0, 0) != 0) {
-		panice("initializing manager semaphore");
+	if (!manager.canons) {
+		panice("allocating canonical hash sets array");
 	}
 
-	Worker *workers = calloc(tasks, sizeof(Worker));
-	if (!workers) {
-		panice("allocating workers array");
+	if (!manager.bounds) {
+		panice("allocating bounds array");
 	}
 
 	for (size_t index = 0; index < tasks; ++ index) {
 		Worker *worker = &workers[index];
 		worker->manager = &manager;
+		worker->stats = (NumbersStats)NUMBERS_STATS_INIT;
+	}
 
-		if (sem_init(&worker->semaphore, 0, 0) != 0) {
-			panice("initializing worker semaphore");
-		}
+	// the non-target numbers in the order of their bits in used
+	Number *stripped = calloc(non_target_count == 0 ? 1 : non_target_count, sizeof(Number));
+	if (!stripped) {
+		panice("allocating numbers array");
 	}
 
 	// put given numbers into the expressions list
@@ -188,29 +553,79 @@ void numbers_solutions(
 			Expr *expr = new_val(number, stripped_index, manager.generation);
 			exprbuf_add(&manager.exprs, expr);
 			exprbuf_add(&manager.segments[expr->used - 1], expr);
+			canonset_add(&manager.canons[expr->used - 1], expr_hash(expr));
+			stripped[stripped_index] = number;
 			++ stripped_index;
 		}
 	}
 
-	// start up all worker threads
-	for (size_t index = 0; index < tasks; ++ index) {
-		Worker *worker = &workers[index];
-		const int errnum = pthread_create(&worker->thread, NULL, &worker_proc, worker);
-		if (errnum != 0) {
-			panicf("starting worker therad: %s", strerror(errnum));
-		}
-	}
+	init_bounds(&manager, options, stripped, non_target_count);
+	free(stripped);
 
 	// [lower, upper) define the range of expressions that have to be combined
 	// with previously generated expressions in this iteration.
 	size_t lower = 0;
 	size_t upper = manager.exprs.size;
 
-#ifdef DEBUG
-	size_t collisions = 0;
-#endif
+	bool completed = true;
+
+	// In shortest mode solutions are collected and only those using the
+	// fewest numbers are passed to the callback at the end. A solution using
+	// n numbers is nested at most n - 1 levels deep, so once a solution with
+	// at most generation + 1 numbers was found no shorter one can follow.
+	const bool shortest = options->shortest;
+	size_t shortest_size = has_single_number_solution ? 1 : SIZE_MAX;
+
+	Checkpoint checkpoint = {
+		.target = target,
+		.bound_mode = options->bound_mode,
+		.bound = options->bound_mode == BoundFixed ? options->bound : 0,
+		.max_size = options->max_size,
+		.generation = 0,
+		.lower = 0
+	};
+
+	if (options->checkpoint) {
+		Checkpoint stored;
+		if (checkpoint_read(options->checkpoint, &stored, &manager.exprs, &uniq_solutions)) {
+			if (stored.target != checkpoint.target ||
+			    stored.bound_mode != checkpoint.bound_mode ||
+			    stored.bound != checkpoint.bound ||
+			    stored.max_size != checkpoint.max_size) {
+				panicf("%s: checkpoint was made for another problem or with other options", options->checkpoint);
+			}
 
-	while (lower < upper) {
+			// the given numbers are already in place
+			for (size_t index = upper; index < manager.exprs.size; ++ index) {
+				Expr *expr = exprbuf_get(&manager.exprs, index);
+				exprbuf_add(&manager.segments[expr->used - 1], expr);
+				canonset_add(&manager.canons[expr->used - 1], expr_hash(expr));
+			}
+
+			for (size_t index = 0; index < uniq_solutions.size; ++ index) {
+				Expr *expr = exprbuf_get(&uniq_solutions, index);
+				canonset_add(&solution_keys, expr_hash(expr));
+				if (shortest) {
+					const size_t size = count_bits(expr->used);
+					if (size < shortest_size) {
+						shortest_size = size;
+					}
+				}
+				else {
+					callback(arg, expr);
+				}
+			}
+
+			manager.generation = stored.generation;
+			lower = stored.lower;
+			upper = manager.exprs.size;
+		}
+	}
+
+	// an expression using n numbers is generated in generation n - 1 or earlier
+	const size_t max_generation = manager.max_size == 0 ? SIZE_MAX : manager.max_size - 1;
+
+	while (has_next_generation(&manager, lower, upper, max_generation, shortest, shortest_size)) {
 		++ manager.generation;
 
 		size_t worker_count = 0;
@@ -227,13 +642,10 @@ void numbers_solutions(
 			const size_t task_upper = upper - task_size < prev_upper ?
 				upper : prev_upper + task_size;
 			Worker *worker = &workers[worker_count];
+			worker->task = TaskCombine;
 			worker->lower = prev_upper;
 			worker->upper = task_upper;
 
-			if (sem_post(&worker->semaphore) != 0) {
-				panice("sending work to worker thread");
-			}
-
 			++ worker_count;
 			prev_upper = task_upper;
 		}
@@ -244,134 +656,245 @@ void numbers_solutions(
 		}
 #endif
 
-		for (size_t finished = 0; finished < worker_count; ++ finished) {
-			if (sem_wait(&manager.semaphore) != 0) {
-				panice("waiting for worker thread");
+		run_workers(pool, worker_count);
+
+		if (is_cancelled(&manager)) {
+			// the output of this generation is incomplete
+			for (size_t index = 0; index < worker_count; ++ index) {
+				free_worker_exprs(&workers[index]);
 			}
+			completed = false;
+			break;
+		}
+
+		// Segments are partitioned between all workers for inserting the new
+		// expressions. This runs in parallel and spreads the segment storage
+		// over the workers' NUMA nodes instead of placing it all on the
+		// manager's node.
+		manager.worker_count = worker_count;
+		for (size_t index = 0; index < tasks; ++ index) {
+			workers[index].task = TaskInsert;
 		}
+		run_workers(pool, tasks);
 
 		for (size_t index = 0; index < worker_count; ++ index) {
 			Worker *worker = &workers[index];
-			for (size_t i = 0; i < worker->new_exprs.size; ++ i) {
-				Expr *expr = worker->new_exprs.buf[i];
-				if (expr->value == target) {
-					if (!exprbuf_contains(&uniq_solutions, expr)) {
-						exprbuf_add(&uniq_solutions, expr);
+			ExprBuf *solutions = (ExprBuf*)&worker->solutions;
+			ExprBuf *new_exprs = (ExprBuf*)&worker->new_exprs;
+
+			for (size_t i = 0; i < solutions->size; ++ i) {
+				Expr *expr = exprbuf_get(solutions, i);
+				if (canonset_add(&solution_keys, expr_hash(expr))) {
+					exprbuf_add(&uniq_solutions, expr);
+					if (shortest) {
+						const size_t size = count_bits(expr->used);
+						if (size < shortest_size) {
+							shortest_size = size;
+						}
+					}
+					else {
 						callback(arg, expr);
 					}
+				}
+				else {
+					++ worker->stats.duplicates;
+					free(expr);
+				}
+			}
+
+			// free the expressions that were dropped by worker_insert() and
+			// compact the rest in place, so it can be appended in bulk
+			size_t kept = 0;
+			for (size_t block_index = 0; block_index < new_exprs->block_count; ++ block_index) {
+				Expr *const *const block = new_exprs->blocks[block_index];
+				const size_t block_size = exprbuf_block_size(new_exprs, block_index);
+				for (size_t i = 0; i < block_size; ++ i) {
+					Expr *expr = block[i];
+					if (expr->generation != GENERATION_DROPPED) {
+						exprbuf_set(new_exprs, kept, expr);
+						++ kept;
+					}
 					else {
-#ifdef DEBUG
-						++ collisions;
-#endif
 						free(expr);
 					}
-				} else if (expr->used != full_usage) {
-					exprbuf_add(&manager.exprs, expr);
-					exprbuf_add(&manager.segments[expr->used - 1], expr);
-				} else {
-					free(expr);
 				}
 			}
-			worker->new_exprs.size = 0;
+			new_exprs->size = kept;
+
+			exprbuf_append(&manager.exprs, new_exprs);
+
+			exprbuf_clear(solutions);
+			exprbuf_clear(new_exprs);
 		}
 
 		lower = upper;
 		upper = manager.exprs.size;
+
+		// after the last generation the finished solve removes the checkpoint
+		if (options->checkpoint &&
+		    has_next_generation(&manager, lower, upper, max_generation, shortest, shortest_size)) {
+			checkpoint.generation = manager.generation;
+			checkpoint.lower = lower;
+			checkpoint_write(options->checkpoint, &checkpoint, &manager.exprs, &uniq_solutions);
+		}
 	}
 
-#ifdef DEBUG
-	printf("collisions: %zu\n", collisions);
-#endif
+	// a finished solve doesn't need to be resumed
+	if (options->checkpoint && completed && remove(options->checkpoint) != 0 && errno != ENOENT) {
+		panice(options->checkpoint);
+	}
 
-	for (size_t index = 0; index < tasks; ++ index) {
-		Worker *worker = &workers[index];
-		worker->lower = 0;
-		worker->upper = 0;
-		if (sem_post(&worker->semaphore) != 0) {
-			perror("signaling end to worker thread");
-		}
+	// the single number solution was already passed to the callback
+	if (shortest && completed && shortest_size > 1 && shortest_size != SIZE_MAX) {
+		emit_shortest(&uniq_solutions, shortest_size, callback, arg);
 	}
 
+	NumbersStats stats = NUMBERS_STATS_INIT;
+	stats.generations = manager.generation;
+	stats.exprs = manager.exprs.size;
+	stats.solutions = uniq_solutions.size + (has_single_number_solution ? 1 : 0);
 	for (size_t index = 0; index < tasks; ++ index) {
-		Worker *worker = &workers[index];
-		const int errnum = pthread_join(worker->thread, NULL);
-		if (errnum != 0) {
-			fprintf(stderr, "wating for worker thread to end: %s\n", strerror(errnum));
-		}
-		if (sem_destroy(&worker->semaphore) != 0) {
-			perror("destroying worker semaphore");
-		}
+		const NumbersStats *worker_stats = &workers[index].stats;
+		stats.duplicates += worker_stats->duplicates;
+		stats.pruned     += worker_stats->pruned;
+		stats.overflows  += worker_stats->overflows;
 	}
 
-	free(workers);
+	if (options->stats) {
+		*options->stats = stats;
+	}
+
+#ifdef DEBUG
+	printf("collisions: %zu\n", stats.duplicates);
+#endif
+
+	if (!options->pool) {
+		numbers_pool_free(pool);
+	}
+	else {
+		// a shared pool is kept between solves, don't keep the buffers of the
+		// biggest one allocated until then
+		for (size_t index = 0; index < tasks; ++ index) {
+			exprbuf_free_buf((ExprBuf*)&workers[index].new_exprs);
+			exprbuf_free_buf((ExprBuf*)&workers[index].solutions);
+		}
+	}
 
 	for (NumberSet index = 0; index < manager.segment_count; ++ index) {
 		exprbuf_free_buf(&manager.segments[index]);
+		canonset_free(&manager.canons[index]);
 	}
 
 	free(manager.segments);
+	free(manager.canons);
+	free(manager.bounds);
+	canonset_free(&solution_keys);
 
 	exprbuf_free_items(&uniq_solutions);
 	exprbuf_free_items(&manager.exprs);
 
-	if (sem_destroy(&manager.semaphore) != 0) {
-		perror("destroying manager semaphore");
-	}
+	return completed;
 }
 
-void *worker_proc(void *arg) {
-	Worker *worker = (Worker*)arg;
-	Manager *manager = worker->manager;
+void worker_combine(Worker *worker) {
+	const Manager *manager = worker->manager;
 	const ExprBuf *segments = manager->segments;
 	const NumberSet segment_count = manager->segment_count;
-
-	for (;;) {
-		if (sem_wait(&worker->semaphore) != 0) {
-			panice("worker waiting for work");
-		}
-
-		const size_t lower = worker->lower;
-		const size_t upper = worker->upper;
-
-		ExprBuf *new_exprs = (ExprBuf*)&worker->new_exprs;
-
-		if (lower == upper) {
-			exprbuf_free_buf(new_exprs);
-			break;
-		}
-
-		const size_t generation = manager->generation;
-		const size_t prev_generation = generation - 1;
-		Expr *const *const exprs = manager->exprs.buf;
-
-		for (size_t b = lower; b < upper; ++ b) {
-			const Expr *bexpr = exprs[b];
-			const NumberSet bused = bexpr->used;
-
-			for (NumberSet aused = 1; aused <= segment_count; ++ aused) {
-				if ((aused & bused) == 0) {
-					const ExprBuf *segment = &segments[aused - 1];
-					Expr *const *const buf = segment->buf;
-					const size_t segment_size = segment->size;
-
-					for (size_t index = 0; index < segment_size; ++ index) {
-						const Expr *aexpr = buf[index];
+	const size_t lower = worker->lower;
+	const size_t upper = worker->upper;
+	const size_t generation = manager->generation;
+	const size_t prev_generation = generation - 1;
+	const size_t max_size = manager->max_size;
+	Expr **const *const exprs = manager->exprs.blocks;
+
+	for (size_t b = lower; b < upper && !is_cancelled(manager); ++ b) {
+		const Expr *bexpr = exprs[b >> EXPRBUF_BLOCK_SHIFT][b & EXPRBUF_BLOCK_MASK];
+		const NumberSet bused = bexpr->used;
+
+		for (NumberSet aused = 1; aused <= segment_count; ++ aused) {
+			if ((aused & bused) == 0 && (max_size == 0 || count_bits(aused | bused) <= max_size)) {
+				const ExprBuf *segment = &segments[aused - 1];
+
+				for (size_t block_index = 0; block_index < segment->block_count; ++ block_index) {
+					Expr *const *const block = segment->blocks[block_index];
+					const size_t block_size = exprbuf_block_size(segment, block_index);
+
+					for (size_t index = 0; index < block_size; ++ index) {
+						const Expr *aexpr = block[index];
 						// This means both expression are new expressions.
 						// Any new expressions will occur as aexpr and as bexpr
 						// in this and thus only one half of the expresions need
 						// to be generated for them here.
 						if (aexpr->generation == prev_generation) {
-							make_half_exprs(new_exprs, aexpr, bexpr, generation);
+							make_half_exprs(worker, aexpr, bexpr, generation);
 						}
 						else {
-							make_exprs(new_exprs, aexpr, bexpr, generation);
+							make_exprs(worker, aexpr, bexpr, generation);
 						}
 					}
 				}
 			}
 		}
+	}
+}
+
+// Inserts the new expressions of all workers that belong to the segments owned
+// by this worker into these segments. Expressions that are equivalent to one
+// that was created in this generation too (by this or another worker) are
+// marked as dropped instead.
+void worker_insert(Worker *worker) {
+	Manager *manager = worker->manager;
+	const size_t tasks = worker->pool->tasks;
+	const size_t worker_count = manager->worker_count;
+
+	for (size_t index = 0; index < worker_count; ++ index) {
+		ExprBuf *new_exprs = (ExprBuf*)&worker->pool->workers[index].new_exprs;
+
+		for (size_t block_index = 0; block_index < new_exprs->block_count; ++ block_index) {
+			Expr *const *const block = new_exprs->blocks[block_index];
+			const size_t block_size = exprbuf_block_size(new_exprs, block_index);
+
+			for (size_t i = 0; i < block_size; ++ i) {
+				Expr *expr = block[i];
+				const NumberSet segment = expr->used - 1;
+				if (segment % tasks == worker->index) {
+					if (canonset_add(&manager->canons[segment], expr_hash(expr))) {
+						exprbuf_add(&manager->segments[segment], expr);
+					}
+					else {
+						++ worker->stats.duplicates;
+						expr->generation = GENERATION_DROPPED;
+					}
+				}
+			}
+		}
+	}
+}
+
+void *worker_proc(void *arg) {
+	Worker *worker = (Worker*)arg;
+	NumbersPool *pool = worker->pool;
+
+	for (;;) {
+		if (sem_wait(&worker->semaphore) != 0) {
+			panice("worker waiting for work");
+		}
+
+		const WorkerTask task = worker->task;
+
+		if (task == TaskQuit) {
+			exprbuf_free_buf((ExprBuf*)&worker->new_exprs);
+			exprbuf_free_buf((ExprBuf*)&worker->solutions);
+			break;
+		}
+		else if (task == TaskInsert) {
+			worker_insert(worker);
+		}
+		else {
+			worker_combine(worker);
+		}
 
-		if (sem_post(&manager->semaphore) != 0) {
+		if (sem_post(&pool->semaphore) != 0) {
 			panice("returning result to manager thread");
 		}
 	}
@@ -6,15 +6,88 @@
 #include <stdbool.h>
 
 #include "expr.h"
+#include "affinity.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef enum NumbersBoundE {
+	// prune values that provably can't be reduced to the target anymore
+	BoundAuto = 0,
+	// like BoundAuto, but also prune values above NumbersOptions.bound
+	BoundFixed,
+	// only prune values that don't fit into Number
+	BoundNone
+} NumbersBound;
+
+typedef struct NumbersStatsS {
+	// number of combination rounds
+	size_t generations;
+	// expressions that were stored for combination
+	size_t exprs;
+	size_t solutions;
+	// expressions dropped because an equivalent one already existed
+	size_t duplicates;
+	// expressions dropped because their value exceeded the bound
+	size_t pruned;
+	// expressions dropped because their value doesn't fit into Number
+	size_t overflows;
+} NumbersStats;
+
+#define NUMBERS_STATS_INIT { \
+	.generations = 0, .exprs = 0, .solutions = 0, \
+	.duplicates = 0, .pruned = 0, .overflows = 0 }
+
+// A pool of worker threads that can be used for many solves, one at a time.
+typedef struct NumbersPoolS NumbersPool;
+
+typedef struct NumbersOptionsS {
+	// number of worker threads (ignored if pool is set)
+	size_t tasks;
+	// how to pin worker threads to CPUs
+	Affinity affinity;
+	// CPUs to use with AffinityList
+	const size_t *cpus;
+	size_t cpu_count;
+	// use these worker threads instead of starting new ones
+	NumbersPool *pool;
+	// the solve is aborted as soon as possible once this becomes true
+	const volatile bool *cancel;
+	// pruning of intermediate values
+	NumbersBound bound_mode;
+	Number bound;
+	// if set, statistics of the solve are written here
+	NumbersStats *stats;
+	// only report the solutions that use the fewest numbers, simplest first,
+	// and stop as soon as no shorter solution can be found anymore
+	bool shortest;
+	// only consider expressions using at most this many numbers (0: no limit)
+	size_t max_size;
+	// if set, the state of the solve is written to this file after every
+	// generation and a solve is resumed from it if the file exists
+	const char *checkpoint;
+} NumbersOptions;
+
+#define NUMBERS_OPTIONS_INIT { \
+	.tasks = 1, .affinity = AffinityNone, .cpus = NULL, .cpu_count = 0, \
+	.pool = NULL, .cancel = NULL, .bound_mode = BoundAuto, .bound = 0, \
+	.stats = NULL, .shortest = false, .max_size = 0, \
+	.checkpoint = NULL }
+
+NumbersPool *numbers_pool_new(const NumbersOptions *options);
+void numbers_pool_free(NumbersPool *pool);
+size_t numbers_pool_tasks(const NumbersPool *pool);
+
 void numbers_solutions(
 	const size_t tasks, const Number target, const Number numbers[],
 	const size_t count, void (*callback)(void*, const Expr*), void *arg);
 
+// Returns false if the solve was cancelled.
+bool numbers_solutions_opts(
+	const NumbersOptions *options, const Number target, const Number numbers[],
+	const size_t count, void (*callback)(void*, const Expr*), void *arg);
+
 #ifdef __cplusplus
 }
 #endif
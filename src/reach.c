@@ -0,0 +1,439 @@
+#include "reach.h"
+#include "panic.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef uint64_t Word;
+
+#define WORD_BITS 64
+
+// a division costs about as much as looking up this many bits
+#define REACH_DIVISION_COST 8
+
+typedef struct ReachS {
+	const Number *numbers;
+	Number cap;
+	// number of words per bitset
+	size_t words;
+	// one bitset per subset of the given numbers, indexed by the subset
+	Word *sets;
+	// number of values in each set
+	size_t *counts;
+} Reach;
+
+static unsigned int count_trailing_zeros(Word word);
+static Word *reach_set(const Reach *reach, NumberSet mask);
+static bool bitset_has(const Word *set, Number value);
+static void bitset_add(Word *set, Number value);
+static size_t bitset_count(const Word *set, size_t words);
+static void bitset_or_shl(Word *set, const Word *src, size_t words, Number shift);
+static void bitset_or_shr(Word *set, const Word *src, size_t words, Number shift);
+static void add_products(const Reach *reach, Word *set, Number a, const Word *bset);
+static void add_quotients(const Reach *reach, Word *set, Number divisor, const Word *dividends, size_t count);
+static void reach_combine(const Reach *reach, Word *set, NumberSet amask, NumberSet bmask);
+static Expr *reach_witness(const Reach *reach, NumberSet mask, Number value);
+static Expr *reach_split(const Reach *reach, NumberSet amask, NumberSet bmask, Number value);
+static void free_tree(Expr *expr);
+
+size_t bitset_count(const Word *set, size_t words) {
+	size_t count = 0;
+	for (size_t word = 0; word < words; ++ word) {
+#if defined(__GNUC__) || defined(__clang__)
+		count += (size_t)__builtin_popcountll(set[word]);
+#else
+		for (Word bits = set[word]; bits; bits &= bits - 1) {
+			++ count;
+		}
+#endif
+	}
+	return count;
+}
+
+// set |= src << shift, bits shifted out of the set are dropped
+void bitset_or_shl(Word *set, const Word *src, size_t words, Number shift) {
+	const size_t word_shift = shift / WORD_BITS;
+	const unsigned int bit_shift = shift % WORD_BITS;
+
+	for (size_t word = word_shift; word < words; ++ word) {
+		const size_t from = word - word_shift;
+		Word bits = src[from] << bit_shift;
+		if (bit_shift != 0 && from > 0) {
+			bits |= src[from - 1] >> (WORD_BITS - bit_shift);
+		}
+		set[word] |= bits;
+	}
+}
+
+// set |= src >> shift
+void bitset_or_shr(Word *set, const Word *src, size_t words, Number shift) {
+	const size_t word_shift = shift / WORD_BITS;
+	const unsigned int bit_shift = shift % WORD_BITS;
+
+	for (size_t word = 0; word + word_shift < words; ++ word) {
+		const size_t from = word + word_shift;
+		Word bits = src[from] >> bit_shift;
+		if (bit_shift != 0 && from + 1 < words) {
+			bits |= src[from + 1] << (WORD_BITS - bit_shift);
+		}
+		set[word] |= bits;
+	}
+}
+
+// Adds a * b for all b != 1 in bset with a * b <= cap. a has to be > 1.
+void add_products(const Reach *reach, Word *set, Number a, const Word *bset) {
+	const Number limit = reach->cap / a;
+	const size_t words = limit / WORD_BITS + 1;
+
+	for (size_t word = 0; word < words; ++ word) {
+		for (Word bits = bset[word]; bits; bits &= bits - 1) {
+			const Number b = word * WORD_BITS + count_trailing_zeros(bits);
+			if (b > limit) {
+				return;
+			}
+			if (b != 1) {
+				bitset_add(set, a * b);
+			}
+		}
+	}
+}
+
+// Adds m / divisor for all m in dividends that are divisible by divisor. Goes
+// through the multiples of divisor or through the dividends, whichever is
+// cheaper. divisor has to be > 1.
+void add_quotients(const Reach *reach, Word *set, Number divisor, const Word *dividends, size_t count) {
+	const Number cap = reach->cap;
+
+	if (cap / divisor < count * REACH_DIVISION_COST) {
+		for (Number quotient = 1; quotient <= cap / divisor; ++ quotient) {
+			if (bitset_has(dividends, quotient * divisor)) {
+				bitset_add(set, quotient);
+			}
+		}
+	}
+	else {
+		for (size_t word = 0; word < reach->words; ++ word) {
+			for (Word bits = dividends[word]; bits; bits &= bits - 1) {
+				const Number m = word * WORD_BITS + count_trailing_zeros(bits);
+				if (m % divisor == 0) {
+					bitset_add(set, m / divisor);
+				}
+			}
+		}
+	}
+}
+
+unsigned int count_trailing_zeros(Word word) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int)__builtin_ctzll(word);
+#else
+	unsigned int count = 0;
+	while ((word & 1) == 0) {
+		word >>= 1;
+		++ count;
+	}
+	return count;
+#endif
+}
+
+Word *reach_set(const Reach *reach, NumberSet mask) {
+	return reach->sets + mask * reach->words;
+}
+
+bool bitset_has(const Word *set, Number value) {
+	return (set[value / WORD_BITS] >> (value % WORD_BITS)) & 1;
+}
+
+void bitset_add(Word *set, Number value) {
+	set[value / WORD_BITS] |= (Word)1 << (value % WORD_BITS);
+}
+
+// Adds all values that can be generated by combining a value of the set of
+// amask with a value of the set of bmask to set. Both operand orders are
+// handled here, so this only needs to be called once per pair of
+// complementary subsets.
+//
+// a + B and B - a are B shifted by a, and A - b is A shifted by b, which is
+// used if that is cheaper than going through all pairs. Products and quotients
+// are generated one by one, but without a division per pair (see
+// add_products() and add_quotients()).
+void reach_combine(const Reach *reach, Word *set, NumberSet amask, NumberSet bmask) {
+	const Number cap = reach->cap;
+	const size_t words = reach->words;
+	const size_t acount = reach->counts[amask];
+	const size_t bcount = reach->counts[bmask];
+	const Word *aset = reach_set(reach, amask);
+	const Word *bset = reach_set(reach, bmask);
+	const bool shift = acount * bcount > (acount + bcount) * words;
+
+	for (size_t aword = 0; aword < words; ++ aword) {
+		for (Word abits = aset[aword]; abits; abits &= abits - 1) {
+			const Number a = aword * WORD_BITS + count_trailing_zeros(abits);
+
+			if (shift) {
+				bitset_or_shl(set, bset, words, a);
+				bitset_or_shr(set, bset, words, a);
+			}
+			else {
+				for (size_t bword = 0; bword < words; ++ bword) {
+					for (Word bbits = bset[bword]; bbits; bbits &= bbits - 1) {
+						const Number b = bword * WORD_BITS + count_trailing_zeros(bbits);
+
+						if (a <= cap - b) {
+							bitset_add(set, a + b);
+						}
+
+						if (a > b) {
+							bitset_add(set, a - b);
+						}
+						else if (b > a) {
+							bitset_add(set, b - a);
+						}
+					}
+				}
+			}
+
+			if (a != 1) {
+				add_products(reach, set, a, bset);
+				add_quotients(reach, set, a, bset, bcount);
+			}
+		}
+	}
+
+	for (size_t bword = 0; bword < words; ++ bword) {
+		for (Word bbits = bset[bword]; bbits; bbits &= bbits - 1) {
+			const Number b = bword * WORD_BITS + count_trailing_zeros(bbits);
+
+			if (shift) {
+				bitset_or_shr(set, aset, words, b);
+			}
+
+			if (b != 1) {
+				add_quotients(reach, set, b, aset, acount);
+			}
+		}
+	}
+
+	if (shift) {
+		// a - a and sums above cap
+		set[0] &= ~(Word)1;
+		const unsigned int last_bits = cap % WORD_BITS + 1;
+		if (last_bits < WORD_BITS) {
+			set[words - 1] &= ((Word)1 << last_bits) - 1;
+		}
+	}
+}
+
+Expr *reach_witness(const Reach *reach, NumberSet mask, Number value) {
+	if ((mask & (mask - 1)) == 0) {
+		const size_t index = count_trailing_zeros(mask);
+		return new_val(reach->numbers[index], index, 0);
+	}
+
+	// only look at splits where amask contains the lowest number, the other
+	// half is covered by trying both operand orders in reach_split()
+	const NumberSet lowest = mask & (~mask + 1);
+	for (NumberSet amask = (mask - 1) & mask; amask; amask = (amask - 1) & mask) {
+		if (amask & lowest) {
+			Expr *expr = reach_split(reach, amask, mask ^ amask, value);
+			if (expr) {
+				return expr;
+			}
+		}
+	}
+
+	panicf("BUG: value " PRIN " is marked reachable but has no witness", value);
+	return NULL;
+}
+
+Expr *reach_split(const Reach *reach, NumberSet amask, NumberSet bmask, Number value) {
+	const Number cap = reach->cap;
+	const size_t words = reach->words;
+	const Word *aset = reach_set(reach, amask);
+	const Word *bset = reach_set(reach, bmask);
+
+	for (size_t aword = 0; aword < words; ++ aword) {
+		for (Word abits = aset[aword]; abits; abits &= abits - 1) {
+			const Number a = aword * WORD_BITS + count_trailing_zeros(abits);
+			Op op;
+			Number b;
+			bool swap;
+
+			if (value > a && bitset_has(bset, value - a)) {
+				b = value - a;
+				op = OpAdd;
+				swap = b < a;
+			}
+			else if (a > value && bitset_has(bset, a - value)) {
+				b = a - value;
+				op = OpSub;
+				swap = false;
+			}
+			else if (a <= cap - value && bitset_has(bset, a + value)) {
+				b = a + value;
+				op = OpSub;
+				swap = true;
+			}
+			else if (value % a == 0 && bitset_has(bset, value / a)) {
+				b = value / a;
+				op = OpMul;
+				swap = b < a;
+			}
+			else if (a % value == 0 && bitset_has(bset, a / value)) {
+				b = a / value;
+				op = OpDiv;
+				swap = false;
+			}
+			else if (a <= cap / value && bitset_has(bset, a * value)) {
+				b = a * value;
+				op = OpDiv;
+				swap = true;
+			}
+			else {
+				continue;
+			}
+
+			Expr *left  = reach_witness(reach, amask, a);
+			Expr *right = reach_witness(reach, bmask, b);
+
+			return swap ?
+				new_expr(op, right, left, 0) :
+				new_expr(op, left, right, 0);
+		}
+	}
+
+	return NULL;
+}
+
+void free_tree(Expr *expr) {
+	if (expr->op != OpVal) {
+		free_tree((Expr*)expr->u.e.left);
+		free_tree((Expr*)expr->u.e.right);
+	}
+	free(expr);
+}
+
+Number reach_default_cap(const Number target, const Number numbers[], const size_t count) {
+	// at least 1, even if the target is 0 and no numbers are given
+	Number max = target == 0 ? 1 : target;
+	for (size_t index = 0; index < count; ++ index) {
+		if (numbers[index] > max) {
+			max = numbers[index];
+		}
+	}
+	return max > ((Number)-1) / REACH_DEFAULT_CAP_FACTOR ?
+		(Number)-1 : max * REACH_DEFAULT_CAP_FACTOR;
+}
+
+bool numbers_reach(
+	const Number cap, const Number target, const Number numbers[],
+	const size_t count, const volatile bool *cancel,
+	void (*callback)(void*, const Expr*), void *arg) {
+
+	if (count > REACH_MAX_COUNT) {
+		panicf("only up to %u numbers supported when using reachability tables", REACH_MAX_COUNT);
+	}
+
+	if (cap == 0 || cap >= SIZE_MAX - WORD_BITS) {
+		panicf("illegal value cap: " PRIN, cap);
+	}
+
+	const NumberSet set_count = (NumberSet)1 << count;
+	Reach reach = {
+		.numbers = numbers,
+		.cap = cap,
+		.words = cap / WORD_BITS + 1,
+		.sets = NULL,
+		.counts = NULL
+	};
+
+	if (SIZE_MAX / sizeof(Word) / reach.words < set_count + 1) {
+		panicf("integer overflow");
+	}
+
+	// the set at index 0 (no numbers used) stays empty, the one after the
+	// last subset is used to collect the union of all sets
+	reach.sets = calloc((set_count + 1) * reach.words, sizeof(Word));
+	if (!reach.sets) {
+		panice("allocating reachability tables");
+	}
+
+	reach.counts = calloc(set_count, sizeof(size_t));
+	if (!reach.counts) {
+		panice("allocating reachability tables");
+	}
+
+	Word *all = reach_set(&reach, set_count);
+
+	for (NumberSet mask = 1; mask < set_count; ++ mask) {
+		if (cancel && *cancel) {
+			free(reach.sets);
+			free(reach.counts);
+			return false;
+		}
+
+		Word *set = reach_set(&reach, mask);
+
+		if ((mask & (mask - 1)) == 0) {
+			const Number number = numbers[count_trailing_zeros(mask)];
+			if (number == 0) {
+				panicf("given numbers may not be 0");
+			}
+			if (number <= cap) {
+				bitset_add(set, number);
+			}
+		}
+		else {
+			// all subsets of mask are smaller than mask and thus already done
+			const NumberSet lowest = mask & (~mask + 1);
+			for (NumberSet amask = (mask - 1) & mask; amask; amask = (amask - 1) & mask) {
+				if (amask & lowest) {
+					reach_combine(&reach, set, amask, mask ^ amask);
+				}
+			}
+		}
+
+		reach.counts[mask] = bitset_count(set, reach.words);
+
+		for (size_t word = 0; word < reach.words; ++ word) {
+			all[word] |= set[word];
+		}
+	}
+
+	// find the target or else the closest reachable value
+	bool found = false;
+	Number value = 0;
+	if (target <= cap && bitset_has(all, target)) {
+		found = true;
+		value = target;
+	}
+	else {
+		const Number start = target <= cap ? target : cap;
+		for (Number distance = 0; distance <= cap; ++ distance) {
+			if (start + distance <= cap && bitset_has(all, start + distance)) {
+				value = start + distance;
+				break;
+			}
+			if (distance < start && bitset_has(all, start - distance)) {
+				value = start - distance;
+				break;
+			}
+		}
+	}
+
+	if (value != 0) {
+		for (NumberSet mask = 1; mask < set_count; ++ mask) {
+			if (bitset_has(reach_set(&reach, mask), value)) {
+				Expr *expr = reach_witness(&reach, mask, value);
+				callback(arg, expr);
+				free_tree(expr);
+				break;
+			}
+		}
+	}
+
+	free(reach.sets);
+	free(reach.counts);
+
+	return found;
+}
@@ -0,0 +1,44 @@
+#ifndef REACH_H
+#define REACH_H
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "expr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bitsets need one set per subset of the given numbers, so this engine is only
+// meant for small problems.
+#define REACH_MAX_COUNT 12
+
+// Default value cap (if none is given) is this times the biggest of the target
+// and the given numbers.
+#define REACH_DEFAULT_CAP_FACTOR 10
+
+// REACH_DEFAULT_CAP_FACTOR times the biggest of target and numbers, saturated
+// at the biggest Number. Never 0.
+Number reach_default_cap(const Number target, const Number numbers[], const size_t count);
+
+// Fast path for small value domains: computes the set of values reachable with
+// each subset of the given numbers as a bitset of all values in [1, cap] and
+// only reconstructs one witness expression. Intermediate values above cap are
+// not considered, so a too small cap can miss solutions.
+//
+// Calls callback once with an expression for the target, or if the target is
+// not reachable with one for the closest reachable value (if any). Returns
+// whether the target itself is reachable. If cancel is given and becomes true
+// the tables are abandoned, callback isn't called and false is returned.
+bool numbers_reach(
+	const Number cap, const Number target, const Number numbers[],
+	const size_t count, const volatile bool *cancel,
+	void (*callback)(void*, const Expr*), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REACH_H
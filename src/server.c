@@ -0,0 +1,1103 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+#include "reach.h"
+#include "panic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// longest accepted request line
+#define SERVER_MAX_LINE 65536
+// longest accepted request id
+#define SERVER_MAX_ID 64
+#define SERVER_READ_SIZE 4096
+// reachability tables of a single request may use at most this much memory
+#define SERVER_MAX_REACH_MEMORY ((size_t)256 * 1024 * 1024)
+#define SERVER_MAX_REACH_COUNT 10
+// The time numbers_reach() takes grows about sixfold with each number and
+// linearly with the words per bitset. This limit of words * 6^count allows
+// about ten seconds.
+#define SERVER_MAX_REACH_WORK UINT64_C(10000000000)
+
+typedef enum ModeE {
+	ModeAll,
+	ModeShortest,
+	ModeReach
+} Mode;
+
+typedef struct TextBufS {
+	char *data;
+	size_t size;
+	size_t capacity;
+} TextBuf;
+
+#define TEXTBUF_INIT { .data = NULL, .size = 0, .capacity = 0 }
+
+typedef struct CacheEntryS {
+	char *key;
+	Hash hash;
+	// response lines without the request id
+	TextBuf body;
+	size_t solutions;
+	struct CacheEntryS *bucket_next;
+	// most recently used first
+	struct CacheEntryS *lru_prev;
+	struct CacheEntryS *lru_next;
+} CacheEntry;
+
+typedef struct CacheS {
+	CacheEntry **buckets;
+	size_t bucket_count;
+	CacheEntry *lru_head;
+	CacheEntry *lru_tail;
+	size_t size;
+	size_t capacity;
+} Cache;
+
+typedef struct ClientS {
+	int fd;
+	TextBuf in;
+	TextBuf out;
+	// set when the connection is to be closed
+	bool closed;
+	// set when the client shut down its side, it's closed once all its jobs
+	// are answered
+	bool eof;
+	// number of jobs that aren't answered yet
+	size_t jobs;
+} Client;
+
+// a later request that is answered with the result of an identical job
+typedef struct WaiterS {
+	Client *client;
+	char id[SERVER_MAX_ID + 1];
+	struct WaiterS *next;
+} Waiter;
+
+typedef struct JobS {
+	// Only used by the event loop. NULL once the client is gone.
+	Client *client;
+	char id[SERVER_MAX_ID + 1];
+	char *key;
+	Mode mode;
+	Number target;
+	Number *numbers;
+	size_t count;
+	volatile bool cancel;
+	// set by the solver thread
+	bool completed;
+	TextBuf body;
+	size_t solutions;
+	// identical requests that arrived while this job wasn't finished yet, in
+	// order of arrival, only used by the event loop
+	Waiter *waiters;
+	// link in the pending or the done queue
+	struct JobS *next;
+	// list of all jobs that are not finished yet, only used by the event loop
+	struct JobS *active_prev;
+	struct JobS *active_next;
+} Job;
+
+typedef struct ServerS {
+	NumbersPool *pool;
+	// base options of every solve
+	NumbersOptions options;
+	Cache cache;
+	size_t max_count;
+	Client **clients;
+	size_t client_count;
+	size_t client_capacity;
+	Job *active;
+
+	// shared between the event loop and the solver thread
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	Job *pending_head;
+	Job *pending_tail;
+	Job *done;
+	bool quit;
+
+	// the solver thread writes a byte to wake_fds[1] when a job is done
+	int wake_fds[2];
+	pthread_t solver;
+} Server;
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void textbuf_reserve(TextBuf *buf, size_t size);
+static void textbuf_append(TextBuf *buf, const char *data, size_t size);
+static void textbuf_append_str(TextBuf *buf, const char *str);
+static void textbuf_append_expr(TextBuf *buf, const char *prefix, const Expr *expr, bool show_value);
+static void textbuf_free(TextBuf *buf);
+
+static Hash hash_str(const char *str);
+static void cache_init(Cache *cache, size_t capacity);
+static CacheEntry *cache_get(Cache *cache, const char *key);
+static void cache_put(Cache *cache, char *key, TextBuf *body, size_t solutions);
+static void cache_unlink(Cache *cache, CacheEntry *entry);
+static void cache_free(Cache *cache);
+
+static void handle_signal(int signum);
+static void set_nonblocking(int fd);
+static void send_line(Client *client, const char *id, const char *line, size_t size);
+static void send_response(Client *client, const char *id, const TextBuf *body, size_t solutions, bool cached);
+static void send_error(Client *client, const char *id, const char *message);
+static void handle_line(Server *server, Client *client, char *line);
+static void handle_solve(Server *server, Client *client, const char *id, char *args);
+static void handle_cancel(Server *server, Client *client, const char *id);
+static void release_job(Job *job);
+static void finish_job(Server *server, Job *job);
+static void free_job(Job *job);
+static void drop_client(Server *server, size_t index);
+static bool read_client(Server *server, Client *client);
+static bool flush_client(Client *client);
+static bool client_finished(const Client *client);
+static int compare_number(const void *lptr, const void *rptr);
+
+static void solve_job(Server *server, Job *job);
+static void job_callback(void *arg, const Expr *expr);
+static void *solver_proc(void *arg);
+
+void textbuf_reserve(TextBuf *buf, size_t size) {
+	if (size > buf->capacity) {
+		size_t capacity = buf->capacity == 0 ? 256 : buf->capacity;
+		while (capacity < size) {
+			if (SIZE_MAX / 2 < capacity) {
+				panicf("integer overflow");
+			}
+			capacity *= 2;
+		}
+		char *data = realloc(buf->data, capacity);
+		if (!data) {
+			panice("resizing text buffer");
+		}
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+}
+
+void textbuf_append(TextBuf *buf, const char *data, size_t size) {
+	textbuf_reserve(buf, buf->size + size);
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+}
+
+void textbuf_append_str(TextBuf *buf, const char *str) {
+	textbuf_append(buf, str, strlen(str));
+}
+
+void textbuf_append_expr(TextBuf *buf, const char *prefix, const Expr *expr, bool show_value) {
+	textbuf_append_str(buf, prefix);
+
+	size_t len = expr_format(buf->data + buf->size, buf->capacity - buf->size, expr);
+	// expr_format() also needs room for the terminating '\0'
+	if (buf->size + len >= buf->capacity) {
+		textbuf_reserve(buf, buf->size + len + 1);
+		expr_format(buf->data + buf->size, buf->capacity - buf->size, expr);
+	}
+	buf->size += len;
+
+	if (show_value) {
+		char value[32];
+		snprintf(value, sizeof(value), " = " PRIN, expr->value);
+		textbuf_append_str(buf, value);
+	}
+
+	textbuf_append(buf, "\n", 1);
+}
+
+void textbuf_free(TextBuf *buf) {
+	free(buf->data);
+	buf->data     = NULL;
+	buf->size     = 0;
+	buf->capacity = 0;
+}
+
+// FNV-1a
+Hash hash_str(const char *str) {
+	Hash hash = 0xcbf29ce484222325u;
+	for (; *str; ++ str) {
+		hash ^= (unsigned char)*str;
+		hash *= 0x100000001b3u;
+	}
+	return hash;
+}
+
+void cache_init(Cache *cache, size_t capacity) {
+	size_t bucket_count = 16;
+	while (bucket_count < capacity) {
+		bucket_count *= 2;
+	}
+
+	cache->buckets = calloc(bucket_count, sizeof(CacheEntry*));
+	if (!cache->buckets) {
+		panice("allocating result cache");
+	}
+	cache->bucket_count = bucket_count;
+	cache->lru_head = NULL;
+	cache->lru_tail = NULL;
+	cache->size = 0;
+	cache->capacity = capacity;
+}
+
+CacheEntry *cache_get(Cache *cache, const char *key) {
+	const Hash hash = hash_str(key);
+	CacheEntry *entry = cache->buckets[hash & (cache->bucket_count - 1)];
+	for (; entry; entry = entry->bucket_next) {
+		if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+			break;
+		}
+	}
+
+	if (entry && entry != cache->lru_head) {
+		// move to the front of the LRU list
+		entry->lru_prev->lru_next = entry->lru_next;
+		if (entry->lru_next) {
+			entry->lru_next->lru_prev = entry->lru_prev;
+		}
+		else {
+			cache->lru_tail = entry->lru_prev;
+		}
+		entry->lru_prev = NULL;
+		entry->lru_next = cache->lru_head;
+		cache->lru_head->lru_prev = entry;
+		cache->lru_head = entry;
+	}
+
+	return entry;
+}
+
+// Takes ownership of key and body.
+void cache_put(Cache *cache, char *key, TextBuf *body, size_t solutions) {
+	if (cache->capacity == 0 || cache_get(cache, key)) {
+		free(key);
+		textbuf_free(body);
+		return;
+	}
+
+	if (cache->size == cache->capacity) {
+		CacheEntry *oldest = cache->lru_tail;
+		cache_unlink(cache, oldest);
+		free(oldest->key);
+		textbuf_free(&oldest->body);
+		free(oldest);
+	}
+
+	CacheEntry *entry = malloc(sizeof(CacheEntry));
+	if (!entry) {
+		panice("allocating cache entry");
+	}
+
+	CacheEntry **bucket = &cache->buckets[hash_str(key) & (cache->bucket_count - 1)];
+	entry->key = key;
+	entry->hash = hash_str(key);
+	entry->body = *body;
+	entry->solutions = solutions;
+	entry->bucket_next = *bucket;
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+	*bucket = entry;
+
+	if (cache->lru_head) {
+		cache->lru_head->lru_prev = entry;
+	}
+	else {
+		cache->lru_tail = entry;
+	}
+	cache->lru_head = entry;
+	++ cache->size;
+
+	*body = (TextBuf)TEXTBUF_INIT;
+}
+
+void cache_unlink(Cache *cache, CacheEntry *entry) {
+	CacheEntry **ptr = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+	while (*ptr != entry) {
+		ptr = &(*ptr)->bucket_next;
+	}
+	*ptr = entry->bucket_next;
+
+	if (entry->lru_prev) {
+		entry->lru_prev->lru_next = entry->lru_next;
+	}
+	else {
+		cache->lru_head = entry->lru_next;
+	}
+
+	if (entry->lru_next) {
+		entry->lru_next->lru_prev = entry->lru_prev;
+	}
+	else {
+		cache->lru_tail = entry->lru_prev;
+	}
+
+	-- cache->size;
+}
+
+void cache_free(Cache *cache) {
+	CacheEntry *entry = cache->lru_head;
+	while (entry) {
+		CacheEntry *next = entry->lru_next;
+		free(entry->key);
+		textbuf_free(&entry->body);
+		free(entry);
+		entry = next;
+	}
+	free(cache->buckets);
+	cache->buckets = NULL;
+	cache->lru_head = NULL;
+	cache->lru_tail = NULL;
+	cache->size = 0;
+}
+
+void handle_signal(int signum) {
+	(void)signum;
+	server_stop = 1;
+}
+
+void set_nonblocking(int fd) {
+	const int flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		panice("setting file descriptor non-blocking");
+	}
+}
+
+void send_line(Client *client, const char *id, const char *line, size_t size) {
+	textbuf_append_str(&client->out, id);
+	textbuf_append(&client->out, " ", 1);
+	textbuf_append(&client->out, line, size);
+}
+
+void send_response(Client *client, const char *id, const TextBuf *body, size_t solutions, bool cached) {
+	// every line of the body gets prefixed with the request id
+	size_t offset = 0;
+	while (offset < body->size) {
+		const char *line = body->data + offset;
+		const char *end = memchr(line, '\n', body->size - offset);
+		const size_t size = end ? (size_t)(end - line) + 1 : body->size - offset;
+		send_line(client, id, line, size);
+		offset += size;
+	}
+
+	char line[64];
+	const int size = snprintf(line, sizeof(line), "done %zu%s\n", solutions, cached ? " cached" : "");
+	send_line(client, id, line, (size_t)size);
+}
+
+void send_error(Client *client, const char *id, const char *message) {
+	textbuf_append_str(&client->out, id);
+	textbuf_append_str(&client->out, " error ");
+	textbuf_append_str(&client->out, message);
+	textbuf_append(&client->out, "\n", 1);
+}
+
+int compare_number(const void *lptr, const void *rptr) {
+	Number l = *(Number*)lptr;
+	Number r = *(Number*)rptr;
+	return l < r ? -1 : r < l ? 1 : 0;
+}
+
+void handle_line(Server *server, Client *client, char *line) {
+	const size_t len = strlen(line);
+	if (len > 0 && line[len - 1] == '\r') {
+		line[len - 1] = '\0';
+	}
+
+	char *saveptr = NULL;
+	const char *command = strtok_r(line, " \t", &saveptr);
+	if (!command) {
+		// ignore empty lines
+		return;
+	}
+
+	const char *id = strtok_r(NULL, " \t", &saveptr);
+	if (!id) {
+		send_error(client, "-", "missing request id");
+		return;
+	}
+
+	if (strlen(id) > SERVER_MAX_ID) {
+		send_error(client, "-", "request id too long");
+		return;
+	}
+
+	if (strcmp(command, "solve") == 0) {
+		handle_solve(server, client, id, saveptr);
+	}
+	else if (strcmp(command, "cancel") == 0) {
+		handle_cancel(server, client, id);
+	}
+	else {
+		send_error(client, id, "unknown command");
+	}
+}
+
+void handle_solve(Server *server, Client *client, const char *id, char *args) {
+	char *saveptr = NULL;
+	const char *mode_str = strtok_r(args, " \t", &saveptr);
+	const char *target_str = strtok_r(NULL, " \t", &saveptr);
+
+	if (!mode_str || !target_str) {
+		send_error(client, id, "expected: solve <id> <mode> <target> [<number>...]");
+		return;
+	}
+
+	Mode mode;
+	if (strcmp(mode_str, "all") == 0) {
+		mode = ModeAll;
+	}
+	else if (strcmp(mode_str, "shortest") == 0) {
+		mode = ModeShortest;
+	}
+	else if (strcmp(mode_str, "reach") == 0) {
+		mode = ModeReach;
+	}
+	else {
+		send_error(client, id, "unknown mode");
+		return;
+	}
+
+	char *endptr = NULL;
+	errno = 0;
+	const Number target = strtoul(target_str, &endptr, 10);
+	if (*endptr || *target_str == '-' || errno == ERANGE) {
+		send_error(client, id, "target is not a number or out of range");
+		return;
+	}
+
+	Number numbers[sizeof(NumberSet) * 8];
+	size_t count = 0;
+	const char *number_str;
+	while ((number_str = strtok_r(NULL, " \t", &saveptr))) {
+		if (count == sizeof(numbers) / sizeof(numbers[0])) {
+			send_error(client, id, "too many numbers");
+			return;
+		}
+		errno = 0;
+		const Number number = strtoul(number_str, &endptr, 10);
+		if (*endptr || *number_str == '-' || errno == ERANGE) {
+			send_error(client, id, "not a number or out of range");
+			return;
+		}
+		if (number == 0) {
+			send_error(client, id, "given numbers may not be 0");
+			return;
+		}
+		numbers[count ++] = number;
+	}
+
+	qsort(numbers, count, sizeof(Number), compare_number);
+
+	if (mode != ModeReach && count > server->max_count) {
+		send_error(client, id, "too many numbers");
+		return;
+	}
+
+	if (mode == ModeReach) {
+		if (count > SERVER_MAX_REACH_COUNT) {
+			send_error(client, id, "too many numbers for reach mode");
+			return;
+		}
+		const size_t words = reach_default_cap(target, numbers, count) / 64 + 1;
+		uint64_t work = words;
+		for (size_t index = 0; index < count && work <= SERVER_MAX_REACH_WORK; ++ index) {
+			work *= 6;
+		}
+		if (SERVER_MAX_REACH_MEMORY / 8 / words < ((size_t)1 << count) + 1 || work > SERVER_MAX_REACH_WORK) {
+			send_error(client, id, "problem too big for reach mode");
+			return;
+		}
+	}
+
+	// key: the sorted multiset of numbers, the target and the mode
+	TextBuf key = TEXTBUF_INIT;
+	char number_buf[32];
+	textbuf_append_str(&key, mode_str);
+	snprintf(number_buf, sizeof(number_buf), " " PRIN, target);
+	textbuf_append_str(&key, number_buf);
+	for (size_t index = 0; index < count; ++ index) {
+		snprintf(number_buf, sizeof(number_buf), " " PRIN, numbers[index]);
+		textbuf_append_str(&key, number_buf);
+	}
+	textbuf_append(&key, "", 1);
+
+	const CacheEntry *entry = cache_get(&server->cache, key.data);
+	if (entry) {
+		send_response(client, id, &entry->body, entry->solutions, true);
+		textbuf_free(&key);
+		return;
+	}
+
+	// an identical request is still being solved, answer this one with its
+	// result once it's done
+	for (Job *job = server->active; job; job = job->active_next) {
+		if (!job->cancel && strcmp(job->key, key.data) == 0) {
+			Waiter *waiter = calloc(1, sizeof(Waiter));
+			if (!waiter) {
+				panice("allocating waiter");
+			}
+			waiter->client = client;
+			strcpy(waiter->id, id);
+
+			Waiter **link = &job->waiters;
+			while (*link) {
+				link = &(*link)->next;
+			}
+			*link = waiter;
+			++ client->jobs;
+			textbuf_free(&key);
+			return;
+		}
+	}
+
+	Job *job = calloc(1, sizeof(Job));
+	if (!job) {
+		panice("allocating job");
+	}
+
+	job->numbers = calloc(count == 0 ? 1 : count, sizeof(Number));
+	if (!job->numbers) {
+		panice("allocating numbers array");
+	}
+	memcpy(job->numbers, numbers, count * sizeof(Number));
+
+	job->client = client;
+	strcpy(job->id, id);
+	job->key = key.data;
+	job->mode = mode;
+	job->target = target;
+	job->count = count;
+	job->cancel = false;
+	job->body = (TextBuf)TEXTBUF_INIT;
+	job->waiters = NULL;
+
+	job->active_next = server->active;
+	if (server->active) {
+		server->active->active_prev = job;
+	}
+	server->active = job;
+	++ client->jobs;
+
+	pthread_mutex_lock(&server->mutex);
+	if (server->pending_tail) {
+		server->pending_tail->next = job;
+	}
+	else {
+		server->pending_head = job;
+	}
+	server->pending_tail = job;
+	pthread_cond_signal(&server->cond);
+	pthread_mutex_unlock(&server->mutex);
+}
+
+void handle_cancel(Server *server, Client *client, const char *id) {
+	for (Job *job = server->active; job; job = job->active_next) {
+		if (job->client == client && strcmp(job->id, id) == 0) {
+			if (job->waiters) {
+				// others still wait for the result
+				job->client = NULL;
+				-- client->jobs;
+				send_line(client, id, "cancelled\n", 10);
+			}
+			else {
+				// answered with "cancelled" once the solver thread gives it back
+				job->cancel = true;
+			}
+			return;
+		}
+
+		for (Waiter **link = &job->waiters; *link; link = &(*link)->next) {
+			Waiter *waiter = *link;
+			if (waiter->client == client && strcmp(waiter->id, id) == 0) {
+				*link = waiter->next;
+				free(waiter);
+				-- client->jobs;
+				send_line(client, id, "cancelled\n", 10);
+				release_job(job);
+				return;
+			}
+		}
+	}
+	send_error(client, id, "no such request");
+}
+
+// Cancels the job if nobody waits for its result anymore.
+void release_job(Job *job) {
+	if (!job->client && !job->waiters) {
+		job->cancel = true;
+	}
+}
+
+void finish_job(Server *server, Job *job) {
+	if (job->active_prev) {
+		job->active_prev->active_next = job->active_next;
+	}
+	else {
+		server->active = job->active_next;
+	}
+	if (job->active_next) {
+		job->active_next->active_prev = job->active_prev;
+	}
+
+	if (job->client) {
+		-- job->client->jobs;
+		if (job->completed) {
+			send_response(job->client, job->id, &job->body, job->solutions, false);
+		}
+		else {
+			send_line(job->client, job->id, "cancelled\n", 10);
+		}
+	}
+
+	while (job->waiters) {
+		Waiter *waiter = job->waiters;
+		-- waiter->client->jobs;
+		if (job->completed) {
+			send_response(waiter->client, waiter->id, &job->body, job->solutions, true);
+		}
+		else {
+			send_line(waiter->client, waiter->id, "cancelled\n", 10);
+		}
+		job->waiters = waiter->next;
+		free(waiter);
+	}
+
+	if (job->completed) {
+		cache_put(&server->cache, job->key, &job->body, job->solutions);
+		job->key = NULL;
+	}
+
+	free_job(job);
+}
+
+void free_job(Job *job) {
+	while (job->waiters) {
+		Waiter *waiter = job->waiters;
+		job->waiters = waiter->next;
+		free(waiter);
+	}
+	free(job->key);
+	free(job->numbers);
+	textbuf_free(&job->body);
+	free(job);
+}
+
+void drop_client(Server *server, size_t index) {
+	Client *client = server->clients[index];
+
+	// cancel everything only this client is still waiting for
+	for (Job *job = server->active; job; job = job->active_next) {
+		if (job->client == client) {
+			job->client = NULL;
+		}
+		Waiter **link = &job->waiters;
+		while (*link) {
+			Waiter *waiter = *link;
+			if (waiter->client == client) {
+				*link = waiter->next;
+				free(waiter);
+			}
+			else {
+				link = &waiter->next;
+			}
+		}
+		release_job(job);
+	}
+
+	close(client->fd);
+	textbuf_free(&client->in);
+	textbuf_free(&client->out);
+	free(client);
+
+	server->clients[index] = server->clients[server->client_count - 1];
+	-- server->client_count;
+}
+
+// Returns false if the connection was closed.
+bool read_client(Server *server, Client *client) {
+	for (;;) {
+		textbuf_reserve(&client->in, client->in.size + SERVER_READ_SIZE);
+		const ssize_t count = read(client->fd, client->in.data + client->in.size, SERVER_READ_SIZE);
+		if (count < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (count == 0) {
+			// still answer everything that was sent before
+			client->eof = true;
+			break;
+		}
+		client->in.size += (size_t)count;
+	}
+
+	// a last line without newline
+	if (client->eof && client->in.size > 0 && client->in.data[client->in.size - 1] != '\n') {
+		textbuf_append(&client->in, "\n", 1);
+	}
+
+	// handle all complete lines, pipelined requests may arrive all at once
+	size_t offset = 0;
+	for (;;) {
+		char *line = client->in.data + offset;
+		char *end = memchr(line, '\n', client->in.size - offset);
+		if (!end) {
+			break;
+		}
+		*end = '\0';
+		handle_line(server, client, line);
+		offset = (size_t)(end - client->in.data) + 1;
+	}
+
+	client->in.size -= offset;
+	memmove(client->in.data, client->in.data + offset, client->in.size);
+
+	if (client->in.size > SERVER_MAX_LINE) {
+		send_error(client, "-", "line too long");
+		client->closed = true;
+	}
+
+	return true;
+}
+
+// Returns false if the connection was closed.
+bool flush_client(Client *client) {
+	size_t offset = 0;
+	while (offset < client->out.size) {
+		const ssize_t count = write(client->fd, client->out.data + offset, client->out.size - offset);
+		if (count < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		offset += (size_t)count;
+	}
+
+	client->out.size -= offset;
+	memmove(client->out.data, client->out.data + offset, client->out.size);
+
+	return true;
+}
+
+// Returns whether everything is sent and nothing more will be sent.
+bool client_finished(const Client *client) {
+	return client->out.size == 0 && (client->closed || (client->eof && client->jobs == 0));
+}
+
+void job_callback(void *arg, const Expr *expr) {
+	Job *job = (Job*)arg;
+	if (expr->value == job->target) {
+		textbuf_append_expr(&job->body, "solution ", expr, false);
+		++ job->solutions;
+	}
+	else {
+		// only happens in reach mode
+		textbuf_append_expr(&job->body, "closest ", expr, true);
+	}
+}
+
+void solve_job(Server *server, Job *job) {
+	if (job->cancel) {
+		job->completed = false;
+		return;
+	}
+
+	if (job->mode == ModeReach) {
+		const Number cap = reach_default_cap(job->target, job->numbers, job->count);
+		numbers_reach(cap, job->target, job->numbers, job->count, &job->cancel, job_callback, job);
+		job->completed = !job->cancel;
+	}
+	else {
+		NumbersOptions options = server->options;
+		options.pool = server->pool;
+		options.cancel = &job->cancel;
+		options.shortest = job->mode == ModeShortest;
+		job->completed = numbers_solutions_opts(
+			&options, job->target, job->numbers, job->count, job_callback, job);
+	}
+}
+
+void *solver_proc(void *arg) {
+	Server *server = (Server*)arg;
+
+	pthread_mutex_lock(&server->mutex);
+	for (;;) {
+		while (!server->pending_head && !server->quit) {
+			pthread_cond_wait(&server->cond, &server->mutex);
+		}
+
+		if (server->quit) {
+			break;
+		}
+
+		Job *job = server->pending_head;
+		server->pending_head = job->next;
+		if (!server->pending_head) {
+			server->pending_tail = NULL;
+		}
+		pthread_mutex_unlock(&server->mutex);
+
+		solve_job(server, job);
+
+		pthread_mutex_lock(&server->mutex);
+		job->next = server->done;
+		server->done = job;
+
+		const char byte = 0;
+		if (write(server->wake_fds[1], &byte, 1) < 0 && errno != EAGAIN) {
+			panice("waking up event loop");
+		}
+	}
+	pthread_mutex_unlock(&server->mutex);
+
+	return NULL;
+}
+
+void numbers_server(const char *path, const ServerOptions *options) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		panicf("socket path too long: %s", path);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// remove a stale socket of a previous run, but nothing else
+	struct stat st;
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		if (unlink(path) != 0) {
+			panice("removing old socket");
+		}
+	}
+
+	const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		panice("creating socket");
+	}
+
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		panice("binding socket");
+	}
+
+	if (listen(listen_fd, SOMAXCONN) != 0) {
+		panice("listening on socket");
+	}
+
+	set_nonblocking(listen_fd);
+
+	Server server = {
+		.pool = numbers_pool_new(&options->solver),
+		.options = options->solver,
+		.max_count = options->max_count,
+		.clients = NULL,
+		.client_count = 0,
+		.client_capacity = 0,
+		.active = NULL,
+		.pending_head = NULL,
+		.pending_tail = NULL,
+		.done = NULL,
+		.quit = false
+	};
+
+	// per request options
+	server.options.checkpoint = NULL;
+	server.options.stats = NULL;
+
+	cache_init(&server.cache, options->cache_size);
+
+	if (pipe(server.wake_fds) != 0) {
+		panice("creating wake up pipe");
+	}
+	set_nonblocking(server.wake_fds[0]);
+	set_nonblocking(server.wake_fds[1]);
+
+	int errnum = pthread_mutex_init(&server.mutex, NULL);
+	if (errnum != 0) {
+		panicf("initializing mutex: %s", strerror(errnum));
+	}
+
+	errnum = pthread_cond_init(&server.cond, NULL);
+	if (errnum != 0) {
+		panicf("initializing condition variable: %s", strerror(errnum));
+	}
+
+	errnum = pthread_create(&server.solver, NULL, &solver_proc, &server);
+	if (errnum != 0) {
+		panicf("starting solver thread: %s", strerror(errnum));
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_signal;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGINT, &action, NULL) != 0 || sigaction(SIGTERM, &action, NULL) != 0) {
+		panice("installing signal handler");
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	struct pollfd *fds = NULL;
+	size_t fds_capacity = 0;
+
+	while (!server_stop) {
+		const size_t fd_count = server.client_count + 2;
+		if (fd_count > fds_capacity) {
+			fds = realloc(fds, fd_count * sizeof(struct pollfd));
+			if (!fds) {
+				panice("resizing poll list");
+			}
+			fds_capacity = fd_count;
+		}
+
+		fds[0] = (struct pollfd){ .fd = listen_fd, .events = POLLIN, .revents = 0 };
+		fds[1] = (struct pollfd){ .fd = server.wake_fds[0], .events = POLLIN, .revents = 0 };
+		for (size_t index = 0; index < server.client_count; ++ index) {
+			const Client *client = server.clients[index];
+			fds[index + 2] = (struct pollfd){
+				.fd = client->fd,
+				.events = (short)(client->closed || client->eof ? 0 : POLLIN) | (client->out.size > 0 ? POLLOUT : 0),
+				.revents = 0
+			};
+		}
+
+		if (poll(fds, fd_count, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			panice("waiting for events");
+		}
+
+		// check the clients first, before the client list changes
+		for (size_t index = server.client_count; index > 0; -- index) {
+			Client *client = server.clients[index - 1];
+			const short revents = fds[index + 1].revents;
+			bool alive = true;
+
+			if (revents & POLLIN) {
+				alive = read_client(&server, client);
+			}
+			else if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				alive = false;
+			}
+
+			if (alive) {
+				alive = flush_client(client) && !client_finished(client);
+			}
+
+			if (!alive) {
+				drop_client(&server, index - 1);
+			}
+		}
+
+		if (fds[1].revents & POLLIN) {
+			char bytes[64];
+			while (read(server.wake_fds[0], bytes, sizeof(bytes)) > 0);
+
+			pthread_mutex_lock(&server.mutex);
+			Job *done = server.done;
+			server.done = NULL;
+			pthread_mutex_unlock(&server.mutex);
+
+			while (done) {
+				Job *next = done->next;
+				finish_job(&server, done);
+				done = next;
+			}
+
+			for (size_t index = server.client_count; index > 0; -- index) {
+				Client *client = server.clients[index - 1];
+				if (!flush_client(client) || client_finished(client)) {
+					drop_client(&server, index - 1);
+				}
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			for (;;) {
+				const int fd = accept(listen_fd, NULL, NULL);
+				if (fd < 0) {
+					if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+						perror("accepting connection");
+					}
+					break;
+				}
+				set_nonblocking(fd);
+
+				Client *client = calloc(1, sizeof(Client));
+				if (!client) {
+					panice("allocating client");
+				}
+				client->fd = fd;
+
+				if (server.client_count == server.client_capacity) {
+					const size_t capacity = server.client_capacity == 0 ? 16 : server.client_capacity * 2;
+					Client **clients = realloc(server.clients, capacity * sizeof(Client*));
+					if (!clients) {
+						panice("resizing client list");
+					}
+					server.clients = clients;
+					server.client_capacity = capacity;
+				}
+				server.clients[server.client_count ++] = client;
+			}
+		}
+	}
+
+	// shut down: cancel everything and wait for the solver thread
+	pthread_mutex_lock(&server.mutex);
+	for (Job *job = server.active; job; job = job->active_next) {
+		job->cancel = true;
+	}
+	server.quit = true;
+	pthread_cond_signal(&server.cond);
+	pthread_mutex_unlock(&server.mutex);
+
+	errnum = pthread_join(server.solver, NULL);
+	if (errnum != 0) {
+		fprintf(stderr, "waiting for solver thread to end: %s\n", strerror(errnum));
+	}
+
+	while (server.active) {
+		Job *job = server.active;
+		server.active = job->active_next;
+		free_job(job);
+	}
+
+	while (server.client_count > 0) {
+		drop_client(&server, server.client_count - 1);
+	}
+
+	free(server.clients);
+	free(fds);
+	cache_free(&server.cache);
+	numbers_pool_free(server.pool);
+
+	pthread_cond_destroy(&server.cond);
+	pthread_mutex_destroy(&server.mutex);
+	close(server.wake_fds[0]);
+	close(server.wake_fds[1]);
+	close(listen_fd);
+	unlink(path);
+}
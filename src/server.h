@@ -0,0 +1,41 @@
+#ifndef SERVER_H
+#define SERVER_H
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "numbers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERVER_DEFAULT_CACHE_SIZE 1024
+#define SERVER_DEFAULT_MAX_COUNT 8
+
+typedef struct ServerOptionsS {
+	// options for the worker pool that is kept for the whole time
+	NumbersOptions solver;
+	// maximum number of cached results
+	size_t cache_size;
+	// maximum number of given numbers of all and shortest requests
+	size_t max_count;
+} ServerOptions;
+
+#define SERVER_OPTIONS_INIT { \
+	.solver = NUMBERS_OPTIONS_INIT, \
+	.cache_size = SERVER_DEFAULT_CACHE_SIZE, \
+	.max_count = SERVER_DEFAULT_MAX_COUNT \
+}
+
+// Listens on the Unix domain socket at path and solves the requests of all
+// connected clients until SIGINT or SIGTERM is received. See README.md for the
+// protocol.
+void numbers_server(const char *path, const ServerOptions *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_H
@@ -0,0 +1,993 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "numbers.h"
+#include "reach.h"
+#include "panic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+// Differential stress test: solves seeded random problems with every mode and
+// number of threads and checks that all of them find the same solutions.
+
+#define STRESS_MAX_COUNT  8
+#define STRESS_MAX_TASKS  16
+// unsolvable problems are found by trial and error
+#define STRESS_MAX_TRIES  1000
+// reach mode is skipped for problems that would need bigger tables
+#define STRESS_MAX_REACH_MEMORY ((size_t)64 * 1024 * 1024)
+// the brute force reference is skipped for problems with more numbers
+#define STRESS_MAX_BRUTE_COUNT 6
+
+typedef enum KindE {
+	// 6 numbers from the tiles of the original game
+	KindClassic,
+	// 5 numbers up to 1000000
+	KindWide,
+	// 6 numbers out of 1 to 4
+	KindDups,
+	// 4 classic tiles and a target that can't be reached
+	KindUnsolvable,
+	KIND_COUNT
+} Kind;
+
+typedef enum ModeE {
+	// the reference: all solutions without pruning by value
+	ModeAll,
+	ModeAuto,
+	ModeShortest,
+	ModeReach,
+	MODE_COUNT
+} Mode;
+
+typedef struct ProblemS {
+	Kind kind;
+	Number target;
+	Number numbers[STRESS_MAX_COUNT];
+	size_t count;
+} Problem;
+
+typedef struct SolutionS {
+	char *text;
+	Hash hash;
+	// number of used given numbers
+	size_t size;
+	Number value;
+} Solution;
+
+typedef struct ResultS {
+	Solution *solutions;
+	size_t count;
+	size_t capacity;
+	// only used in reach mode
+	bool found;
+	double millis;
+} Result;
+
+typedef struct VariantS {
+	Mode mode;
+	size_t tasks;
+	NumbersPool *pool;
+	// latencies of all runs in milliseconds
+	double *millis;
+	size_t runs;
+	size_t solutions;
+	double total_millis;
+} Variant;
+
+// Evaluates the text of a solution independently of the expression it was
+// formatted from.
+typedef struct ParserS {
+	const char *pos;
+	Number used[STRESS_MAX_COUNT];
+	size_t used_count;
+	// biggest intermediate value
+	Number max;
+	bool ok;
+} Parser;
+
+// expression tree of the brute force reference
+typedef struct BruteNodeS {
+	Op op;
+	Number value;
+	size_t left;
+	size_t right;
+} BruteNode;
+
+typedef struct BruteS {
+	const Problem *problem;
+	// the given numbers, then the operations of the current search path
+	BruteNode nodes[STRESS_MAX_BRUTE_COUNT * 2];
+	size_t node_count;
+	bool *reachable;
+} Brute;
+
+typedef struct OptionsS {
+	uint64_t seed;
+	size_t count;
+	bool kinds[KIND_COUNT];
+	size_t tasks[STRESS_MAX_TASKS];
+	size_t task_count;
+} Options;
+
+static const char *KIND_NAMES[KIND_COUNT] = { "classic", "wide", "dups", "unsolvable" };
+static const char *MODE_NAMES[MODE_COUNT] = { "all", "auto", "shortest", "reach" };
+
+static const Number TILES[] = {
+	1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+	25, 50, 75, 100
+};
+
+static uint64_t next_random(uint64_t *state);
+static Number random_range(uint64_t *state, Number min, Number max);
+static int compare_number(const void *lptr, const void *rptr);
+static int compare_text(const void *lptr, const void *rptr);
+static int compare_hash(const void *lptr, const void *rptr);
+static int compare_double(const void *lptr, const void *rptr);
+static size_t count_bits(NumberSet set);
+static void pick_tiles(uint64_t *state, Problem *problem, size_t count);
+static Number plant_target(uint64_t *state, const Problem *problem);
+static void generate(uint64_t *state, Kind kind, NumbersPool *pool, Problem *problem);
+static void callback(void *arg, const Expr *expr);
+static bool reach_fits(const Problem *problem);
+static void solve(Variant *variant, const Problem *problem, Result *result);
+static void free_result(Result *result);
+static void sort_texts(Result *result);
+static Hash *sorted_hashes(const Result *result, size_t size, size_t *count);
+static bool same_texts(const Result *left, const Result *right);
+static bool same_hashes(const Result *left, size_t left_size, const Result *right, size_t right_size);
+static size_t shortest_size(const Result *result);
+static Number parse_sum(Parser *parser);
+static Number parse_product(Parser *parser);
+static Number parse_factor(Parser *parser);
+static Number parse_apply(Parser *parser, Op op, Number left, Number right);
+static bool valid_text(const Problem *problem, const Solution *solution, NumberSet *mask, Number *max);
+static NumberSet canonical_mask(const Problem *problem, NumberSet mask);
+static bool brute_normal(const Brute *brute, size_t node, bool root);
+static void brute_search(Brute *brute, const size_t items[], const NumberSet masks[], size_t count);
+static void brute_force(const Problem *problem, bool reachable[]);
+static bool check_texts(const Problem *problem, const Result *result, const bool reachable[]);
+static bool check(const Variant *variant, const Problem *problem, const bool reachable[], const Result *reference, const Result *first, const Result *result);
+static void print_problem(FILE *stream, const Problem *problem);
+static void print_variant(const Variant *variant);
+static size_t parse_size(const char *str, const char *errmsg);
+static void parse_options(int argc, char *argv[], Options *options);
+
+// splitmix64
+uint64_t next_random(uint64_t *state) {
+	uint64_t value = (*state += UINT64_C(0x9e3779b97f4a7c15));
+	value = (value ^ (value >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	value = (value ^ (value >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return value ^ (value >> 31);
+}
+
+Number random_range(uint64_t *state, Number min, Number max) {
+	return min + (Number)(next_random(state) % (max - min + 1));
+}
+
+int compare_number(const void *lptr, const void *rptr) {
+	Number l = *(Number*)lptr;
+	Number r = *(Number*)rptr;
+	return l < r ? -1 : r < l ? 1 : 0;
+}
+
+int compare_text(const void *lptr, const void *rptr) {
+	return strcmp(((const Solution*)lptr)->text, ((const Solution*)rptr)->text);
+}
+
+int compare_hash(const void *lptr, const void *rptr) {
+	Hash l = *(Hash*)lptr;
+	Hash r = *(Hash*)rptr;
+	return l < r ? -1 : r < l ? 1 : 0;
+}
+
+int compare_double(const void *lptr, const void *rptr) {
+	double l = *(double*)lptr;
+	double r = *(double*)rptr;
+	return l < r ? -1 : r < l ? 1 : 0;
+}
+
+size_t count_bits(NumberSet set) {
+	size_t count = 0;
+	for (; set; set &= set - 1) {
+		++ count;
+	}
+	return count;
+}
+
+void pick_tiles(uint64_t *state, Problem *problem, size_t count) {
+	Number tiles[sizeof(TILES) / sizeof(TILES[0])];
+	const size_t tile_count = sizeof(TILES) / sizeof(TILES[0]);
+	memcpy(tiles, TILES, sizeof(TILES));
+
+	// partial Fisher-Yates shuffle
+	for (size_t index = 0; index < count; ++ index) {
+		const size_t other = (size_t)random_range(state, index, tile_count - 1);
+		const Number tile = tiles[other];
+		tiles[other] = tiles[index];
+		tiles[index] = tile;
+		problem->numbers[index] = tile;
+	}
+	problem->count = count;
+}
+
+// Combines some of the numbers in random order with random operations, so the
+// problem has at least one solution.
+Number plant_target(uint64_t *state, const Problem *problem) {
+	Number numbers[STRESS_MAX_COUNT];
+	memcpy(numbers, problem->numbers, problem->count * sizeof(Number));
+	for (size_t index = 0; index + 1 < problem->count; ++ index) {
+		const size_t other = (size_t)random_range(state, index, problem->count - 1);
+		const Number number = numbers[other];
+		numbers[other] = numbers[index];
+		numbers[index] = number;
+	}
+
+	Number value = numbers[0];
+	const size_t steps = (size_t)random_range(state, 1, problem->count - 1);
+
+	for (size_t step = 1; step <= steps; ++ step) {
+		const Number number = numbers[step];
+		switch (next_random(state) % 4) {
+		case OpAdd:
+			value += number;
+			break;
+
+		case OpSub:
+			value = value > number ? value - number : value + number;
+			break;
+
+		case OpDiv:
+			value = value % number == 0 ? value / number : value + number;
+			break;
+
+		default:
+			value = value <= NUMBER_MAX / number ? value * number : value + number;
+			break;
+		}
+	}
+
+	return value;
+}
+
+void generate(uint64_t *state, Kind kind, NumbersPool *pool, Problem *problem) {
+	problem->kind = kind;
+
+	switch (kind) {
+	case KindClassic:
+		pick_tiles(state, problem, 6);
+		problem->target = random_range(state, 101, 999);
+		break;
+
+	case KindWide:
+		problem->count = 5;
+		for (size_t index = 0; index < problem->count; ++ index) {
+			problem->numbers[index] = random_range(state, 1, 1000000);
+		}
+		problem->target = plant_target(state, problem);
+		break;
+
+	case KindDups:
+		problem->count = 6;
+		for (size_t index = 0; index < problem->count; ++ index) {
+			problem->numbers[index] = random_range(state, 1, 4);
+		}
+		problem->target = next_random(state) % 2 == 0 ?
+			plant_target(state, problem) : random_range(state, 1, 500);
+		break;
+
+	case KindUnsolvable:
+	{
+		NumbersStats stats = NUMBERS_STATS_INIT;
+		NumbersOptions options = NUMBERS_OPTIONS_INIT;
+		options.pool = pool;
+		options.stats = &stats;
+		options.shortest = true;
+		for (size_t tries = 0;; ++ tries) {
+			if (tries == STRESS_MAX_TRIES) {
+				panicf("no unsolvable problem found after %d tries", STRESS_MAX_TRIES);
+			}
+			pick_tiles(state, problem, 4);
+			problem->target = random_range(state, 101, 999);
+			qsort(problem->numbers, problem->count, sizeof(Number), compare_number);
+			numbers_solutions_opts(&options, problem->target, problem->numbers,
+				problem->count, callback, NULL);
+			if (stats.solutions == 0) {
+				break;
+			}
+		}
+		break;
+	}
+	default:
+		panicf("illegal problem kind");
+	}
+
+	qsort(problem->numbers, problem->count, sizeof(Number), compare_number);
+}
+
+void callback(void *arg, const Expr *expr) {
+	Result *result = (Result*)arg;
+	if (!result) {
+		return;
+	}
+
+	if (result->count == result->capacity) {
+		const size_t capacity = result->capacity == 0 ? 64 : result->capacity * 2;
+		Solution *solutions = realloc(result->solutions, capacity * sizeof(Solution));
+		if (!solutions) {
+			panice("resizing solutions array");
+		}
+		result->solutions = solutions;
+		result->capacity = capacity;
+	}
+
+	const size_t len = expr_format(NULL, 0, expr);
+	char *text = malloc(len + 1);
+	if (!text) {
+		panice("allocating solution text");
+	}
+	expr_format(text, len + 1, expr);
+
+	Solution *solution = &result->solutions[result->count ++];
+	solution->text = text;
+	solution->hash = expr_hash(expr);
+	solution->size = count_bits(expr->used);
+	solution->value = expr->value;
+}
+
+bool reach_fits(const Problem *problem) {
+	const size_t words = reach_default_cap(problem->target, problem->numbers, problem->count) / 64 + 1;
+	return words <= STRESS_MAX_REACH_MEMORY / sizeof(uint64_t) >> problem->count;
+}
+
+void solve(Variant *variant, const Problem *problem, Result *result) {
+	struct timespec start, end;
+	NumbersOptions options = NUMBERS_OPTIONS_INIT;
+	options.pool = variant->pool;
+	options.bound_mode = variant->mode == ModeAll ? BoundNone : BoundAuto;
+	options.shortest = variant->mode == ModeShortest;
+
+	*result = (Result){ .solutions = NULL, .count = 0, .capacity = 0, .found = false, .millis = 0 };
+
+	if (clock_gettime(CLOCK_MONOTONIC, &start) != 0) {
+		panice("getting time");
+	}
+
+	if (variant->mode == ModeReach) {
+		const Number cap = reach_default_cap(problem->target, problem->numbers, problem->count);
+		result->found = numbers_reach(cap, problem->target, problem->numbers, problem->count, NULL, callback, result);
+	}
+	else {
+		numbers_solutions_opts(&options, problem->target, problem->numbers, problem->count, callback, result);
+	}
+
+	if (clock_gettime(CLOCK_MONOTONIC, &end) != 0) {
+		panice("getting time");
+	}
+
+	result->millis = (double)(end.tv_sec - start.tv_sec) * 1000.0 +
+		(double)(end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+	variant->millis[variant->runs ++] = result->millis;
+	variant->total_millis += result->millis;
+	variant->solutions += variant->mode == ModeReach ? (result->found ? 1 : 0) : result->count;
+}
+
+void free_result(Result *result) {
+	for (size_t index = 0; index < result->count; ++ index) {
+		free(result->solutions[index].text);
+	}
+	free(result->solutions);
+	result->solutions = NULL;
+	result->count = 0;
+	result->capacity = 0;
+}
+
+void sort_texts(Result *result) {
+	qsort(result->solutions, result->count, sizeof(Solution), compare_text);
+}
+
+// Canonical hashes of the solutions using size numbers (0: all solutions).
+Hash *sorted_hashes(const Result *result, size_t size, size_t *count) {
+	Hash *hashes = calloc(result->count == 0 ? 1 : result->count, sizeof(Hash));
+	if (!hashes) {
+		panice("allocating hashes array");
+	}
+
+	*count = 0;
+	for (size_t index = 0; index < result->count; ++ index) {
+		if (size == 0 || result->solutions[index].size == size) {
+			hashes[(*count) ++] = result->solutions[index].hash;
+		}
+	}
+
+	qsort(hashes, *count, sizeof(Hash), compare_hash);
+	return hashes;
+}
+
+// Both results have to be sorted with sort_texts().
+bool same_texts(const Result *left, const Result *right) {
+	if (left->count != right->count) {
+		return false;
+	}
+	for (size_t index = 0; index < left->count; ++ index) {
+		if (strcmp(left->solutions[index].text, right->solutions[index].text) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Different modes may find different but equivalent expressions first, so
+// these are compared by their canonical signatures.
+bool same_hashes(const Result *left, size_t left_size, const Result *right, size_t right_size) {
+	size_t left_count, right_count;
+	Hash *left_hashes  = sorted_hashes(left, left_size, &left_count);
+	Hash *right_hashes = sorted_hashes(right, right_size, &right_count);
+
+	const bool same = left_count == right_count &&
+		memcmp(left_hashes, right_hashes, left_count * sizeof(Hash)) == 0;
+
+	free(left_hashes);
+	free(right_hashes);
+	return same;
+}
+
+size_t shortest_size(const Result *result) {
+	size_t size = SIZE_MAX;
+	for (size_t index = 0; index < result->count; ++ index) {
+		if (result->solutions[index].size < size) {
+			size = result->solutions[index].size;
+		}
+	}
+	return size;
+}
+
+// Intermediate values have to stay positive and divisions exact, like in the
+// solver. Any violation or overflow marks the text as invalid.
+Number parse_apply(Parser *parser, Op op, Number left, Number right) {
+	Number value = 0;
+	if ((op == OpSub && left <= right) ||
+		(op == OpDiv && left % right != 0) ||
+		!op_checked(op, left, right, &value)) {
+		parser->ok = false;
+		return 1;
+	}
+	if (value > parser->max) {
+		parser->max = value;
+	}
+	return value;
+}
+
+Number parse_sum(Parser *parser) {
+	Number value = parse_product(parser);
+	while (parser->ok && (strncmp(parser->pos, " + ", 3) == 0 || strncmp(parser->pos, " - ", 3) == 0)) {
+		const Op op = parser->pos[1] == '+' ? OpAdd : OpSub;
+		parser->pos += 3;
+		value = parse_apply(parser, op, value, parse_product(parser));
+	}
+	return value;
+}
+
+Number parse_product(Parser *parser) {
+	Number value = parse_factor(parser);
+	while (parser->ok && (strncmp(parser->pos, " * ", 3) == 0 || strncmp(parser->pos, " / ", 3) == 0)) {
+		const Op op = parser->pos[1] == '*' ? OpMul : OpDiv;
+		parser->pos += 3;
+		value = parse_apply(parser, op, value, parse_factor(parser));
+	}
+	return value;
+}
+
+Number parse_factor(Parser *parser) {
+	if (*parser->pos == '(') {
+		++ parser->pos;
+		const Number value = parse_sum(parser);
+		if (*parser->pos != ')') {
+			parser->ok = false;
+			return 1;
+		}
+		++ parser->pos;
+		return value;
+	}
+
+	char *endptr = NULL;
+	const Number value = strtoull(parser->pos, &endptr, 10);
+	if (endptr == parser->pos || value == 0 || parser->used_count == STRESS_MAX_COUNT) {
+		parser->ok = false;
+		return 1;
+	}
+	parser->pos = endptr;
+	parser->used[parser->used_count ++] = value;
+	if (value > parser->max) {
+		parser->max = value;
+	}
+	return value;
+}
+
+// Whether the text of the solution evaluates to its value and only uses the
+// given numbers, each at most as often as given. Also returns the used
+// numbers as canonical mask (see canonical_mask()) and the biggest
+// intermediate value.
+bool valid_text(const Problem *problem, const Solution *solution, NumberSet *mask, Number *max) {
+	Parser parser = { .pos = solution->text, .used_count = 0, .max = 0, .ok = true };
+	const Number value = parse_sum(&parser);
+	if (!parser.ok || *parser.pos || value != solution->value) {
+		return false;
+	}
+
+	// both sorted, so this is a merge
+	qsort(parser.used, parser.used_count, sizeof(Number), compare_number);
+	size_t given = 0;
+	*mask = 0;
+	for (size_t index = 0; index < parser.used_count; ++ index) {
+		while (given < problem->count && problem->numbers[given] < parser.used[index]) {
+			++ given;
+		}
+		if (given == problem->count || problem->numbers[given] != parser.used[index]) {
+			return false;
+		}
+		*mask |= (NumberSet)1 << given;
+		++ given;
+	}
+	*max = parser.max;
+	return true;
+}
+
+// Equal given numbers are interchangeable, so of each run of equal numbers
+// (they are sorted) the mask uses the first ones.
+NumberSet canonical_mask(const Problem *problem, NumberSet mask) {
+	NumberSet canonical = 0;
+	size_t start = 0;
+	while (start < problem->count) {
+		size_t end = start;
+		size_t used = 0;
+		while (end < problem->count && problem->numbers[end] == problem->numbers[start]) {
+			used += (mask >> end) & 1;
+			++ end;
+		}
+		for (size_t index = start; index < start + used; ++ index) {
+			canonical |= (NumberSet)1 << index;
+		}
+		start = end;
+	}
+	return canonical;
+}
+
+// Whether the solver can build the normalized form of the expression at node:
+// chains of additions/subtractions (multiplications/divisions) are flattened
+// into positive terms and negative terms, which are applied in ascending order
+// of their values. The solver never uses a subexpression that equals the
+// target, doesn't multiply or divide by 1 and doesn't subtract or divide if
+// the result equals the right operand (except for x / x).
+bool brute_normal(const Brute *brute, size_t node, bool root) {
+	const BruteNode *expr = &brute->nodes[node];
+	if (!root && expr->value == brute->problem->target) {
+		return false;
+	}
+	if (expr->op == OpVal) {
+		return true;
+	}
+
+	const bool additive = expr->op == OpAdd || expr->op == OpSub;
+	Number terms[2][STRESS_MAX_BRUTE_COUNT];
+	size_t counts[2] = { 0, 0 };
+	size_t stack[STRESS_MAX_BRUTE_COUNT * 2];
+	bool negative[STRESS_MAX_BRUTE_COUNT * 2];
+	size_t top = 0;
+
+	stack[top] = node;
+	negative[top ++] = false;
+	while (top > 0) {
+		-- top;
+		const BruteNode *item = &brute->nodes[stack[top]];
+		const bool item_negative = negative[top];
+		if (item->op != OpVal && (item->op == OpAdd || item->op == OpSub) == additive) {
+			const bool right_negative = item->op == OpSub || item->op == OpDiv;
+			stack[top] = item->left;
+			negative[top ++] = item_negative;
+			stack[top] = item->right;
+			negative[top ++] = item_negative != right_negative;
+		}
+		else if (!brute_normal(brute, stack[top], false)) {
+			return false;
+		}
+		else {
+			terms[item_negative][counts[item_negative] ++] = item->value;
+		}
+	}
+
+	qsort(terms[0], counts[0], sizeof(Number), compare_number);
+	qsort(terms[1], counts[1], sizeof(Number), compare_number);
+
+	Number value = terms[0][0];
+	const size_t steps = counts[0] + counts[1] - 1;
+	for (size_t step = 0; step < steps; ++ step) {
+		const bool subtract = step + 1 >= counts[0];
+		const Number term = subtract ? terms[1][step + 1 - counts[0]] : terms[0][step + 1];
+		Op op;
+		if (additive) {
+			op = subtract ? OpSub : OpAdd;
+		}
+		else {
+			op = subtract ? OpDiv : OpMul;
+			if (term == 1 || value == 1) {
+				return false;
+			}
+		}
+
+		if ((op == OpSub && (value <= term || value - term == term)) ||
+			(op == OpDiv && (value % term != 0 || (value / term == term && value != term)))) {
+			return false;
+		}
+		Number result = 0;
+		if (!op_checked(op, value, term, &result)) {
+			return false;
+		}
+		if (step + 1 < steps && result == brute->problem->target) {
+			return false;
+		}
+		value = result;
+	}
+
+	return true;
+}
+
+// Tries all pairs of the remaining expressions with all operations that give a
+// positive whole number. Every expression that equals the target is checked
+// with brute_normal().
+void brute_search(Brute *brute, const size_t items[], const NumberSet masks[], size_t count) {
+	size_t next_items[STRESS_MAX_BRUTE_COUNT];
+	NumberSet next_masks[STRESS_MAX_BRUTE_COUNT];
+
+	for (size_t i = 0; i < count; ++ i) {
+		for (size_t j = i + 1; j < count; ++ j) {
+			const bool ordered = brute->nodes[items[i]].value >= brute->nodes[items[j]].value;
+			const size_t left  = ordered ? items[i] : items[j];
+			const size_t right = ordered ? items[j] : items[i];
+			const Number a = brute->nodes[left].value;
+			const Number b = brute->nodes[right].value;
+			const NumberSet mask = masks[i] | masks[j];
+
+			size_t rest = 0;
+			for (size_t index = 0; index < count; ++ index) {
+				if (index != i && index != j) {
+					next_items[rest] = items[index];
+					next_masks[rest] = masks[index];
+					++ rest;
+				}
+			}
+
+			for (Op op = OpAdd; op < OpVal; ++ op) {
+				Number value = 0;
+				if ((op == OpSub && a == b) || (op == OpDiv && a % b != 0) || !op_checked(op, a, b, &value)) {
+					continue;
+				}
+
+				const size_t node = brute->node_count ++;
+				brute->nodes[node] = (BruteNode){ .op = op, .value = value, .left = left, .right = right };
+
+				if (value == brute->problem->target && brute_normal(brute, node, true)) {
+					brute->reachable[canonical_mask(brute->problem, mask)] = true;
+				}
+
+				if (rest > 0) {
+					next_items[rest] = node;
+					next_masks[rest] = mask;
+					brute_search(brute, next_items, next_masks, rest + 1);
+				}
+
+				-- brute->node_count;
+			}
+		}
+	}
+}
+
+// Independent reference for mode all: which multisets of the given numbers
+// (as canonical masks) the target can be made from.
+void brute_force(const Problem *problem, bool reachable[]) {
+	Brute brute = { .problem = problem, .node_count = 0, .reachable = reachable };
+	size_t items[STRESS_MAX_BRUTE_COUNT];
+	NumberSet masks[STRESS_MAX_BRUTE_COUNT];
+
+	memset(reachable, 0, ((size_t)1 << problem->count) * sizeof(bool));
+
+	for (size_t index = 0; index < problem->count; ++ index) {
+		brute.nodes[index] = (BruteNode){ .op = OpVal, .value = problem->numbers[index], .left = 0, .right = 0 };
+		items[index] = index;
+		masks[index] = (NumberSet)1 << index;
+		if (problem->numbers[index] == problem->target) {
+			reachable[canonical_mask(problem, masks[index])] = true;
+		}
+	}
+	brute.node_count = problem->count;
+
+	brute_search(&brute, items, masks, problem->count);
+}
+
+// Every solution has to be valid and reach the target. If reachable is given,
+// the solutions also have to use exactly the multisets of numbers the target
+// can be made from.
+bool check_texts(const Problem *problem, const Result *result, const bool reachable[]) {
+	bool found[1 << STRESS_MAX_COUNT] = { false };
+
+	for (size_t index = 0; index < result->count; ++ index) {
+		const Solution *solution = &result->solutions[index];
+		NumberSet mask;
+		Number max;
+		if (!valid_text(problem, solution, &mask, &max) || solution->value != problem->target) {
+			return false;
+		}
+		found[mask] = true;
+	}
+
+	if (reachable) {
+		for (NumberSet mask = 0; mask < (NumberSet)1 << problem->count; ++ mask) {
+			if (found[mask] != reachable[mask]) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// result is compared to the reference (mode all, first number of threads) and
+// to the result of the same mode with the first number of threads.
+// The reference itself is checked against the brute force (if reachable is
+// given).
+bool check(const Variant *variant, const Problem *problem, const bool reachable[], const Result *reference, const Result *first, const Result *result) {
+	switch (variant->mode) {
+	case ModeAll:
+		return check_texts(problem, result, reachable) &&
+			same_texts(first, result) && same_hashes(reference, 0, result, 0);
+
+	case ModeAuto:
+		return check_texts(problem, result, NULL) &&
+			same_texts(first, result) && same_hashes(reference, 0, result, 0);
+
+	case ModeShortest:
+		if (reference->count == 0) {
+			return result->count == 0;
+		}
+		return check_texts(problem, result, NULL) && same_texts(first, result) &&
+			same_hashes(reference, shortest_size(reference), result, 0);
+
+	case ModeReach:
+	{
+		// the witness is built separately from the solver's expressions
+		if (result->count != 1) {
+			return false;
+		}
+		for (size_t index = 0; index < result->count; ++ index) {
+			NumberSet mask;
+			Number max;
+			if (!valid_text(problem, &result->solutions[index], &mask, &max) ||
+				(result->solutions[index].value == problem->target) != result->found) {
+				return false;
+			}
+		}
+
+		// values above the cap aren't considered, so reach may miss solutions,
+		// but not those whose intermediate values all are within the cap
+		const Number cap = reach_default_cap(problem->target, problem->numbers, problem->count);
+		bool within_cap = false;
+		for (size_t index = 0; index < reference->count && !within_cap; ++ index) {
+			NumberSet mask;
+			Number max;
+			within_cap = valid_text(problem, &reference->solutions[index], &mask, &max) && max <= cap;
+		}
+		return result->found ? reference->count > 0 : !within_cap;
+	}
+
+	default:
+		panicf("illegal mode");
+		return false;
+	}
+}
+
+void print_problem(FILE *stream, const Problem *problem) {
+	fprintf(stream, "%s: " PRIN, KIND_NAMES[problem->kind], problem->target);
+	for (size_t index = 0; index < problem->count; ++ index) {
+		fprintf(stream, " " PRIN, problem->numbers[index]);
+	}
+	fputc('\n', stream);
+}
+
+// nearest-rank percentiles
+void print_variant(const Variant *variant) {
+	qsort(variant->millis, variant->runs, sizeof(double), compare_double);
+	const size_t runs = variant->runs;
+	const double *millis = variant->millis;
+	const size_t p50 = runs == 0 ? 0 : (runs * 50 + 99) / 100 - 1;
+	const size_t p90 = runs == 0 ? 0 : (runs * 90 + 99) / 100 - 1;
+	const size_t p99 = runs == 0 ? 0 : (runs * 99 + 99) / 100 - 1;
+
+	printf("%-9s %5zu %6zu %10zu %10.1f %9.3f %9.3f %9.3f %9.3f\n",
+		MODE_NAMES[variant->mode], variant->tasks, runs, variant->solutions,
+		variant->total_millis > 0 ? runs * 1000.0 / variant->total_millis : 0.0,
+		runs ? millis[p50] : 0.0, runs ? millis[p90] : 0.0,
+		runs ? millis[p99] : 0.0, runs ? millis[runs - 1] : 0.0);
+}
+
+size_t parse_size(const char *str, const char *errmsg) {
+	char *endptr = NULL;
+	const unsigned long long value = strtoull(str, &endptr, 10);
+	if (!*str || *endptr) {
+		panicf("%s: %s", errmsg, str);
+	}
+	return (size_t)value;
+}
+
+void parse_options(int argc, char *argv[], Options *options) {
+	for (int argind = 1; argind < argc; ++ argind) {
+		const char *arg = argv[argind];
+
+		if (strncmp(arg, "--seed=", 7) == 0) {
+			options->seed = parse_size(arg + 7, "seed is not a number");
+		}
+		else if (strncmp(arg, "--count=", 8) == 0) {
+			options->count = parse_size(arg + 8, "count is not a number");
+		}
+		else if (strncmp(arg, "--kinds=", 8) == 0) {
+			char *list = strdup(arg + 8);
+			char *saveptr = NULL;
+			if (!list) {
+				panice("copying problem kinds");
+			}
+			for (size_t kind = 0; kind < KIND_COUNT; ++ kind) {
+				options->kinds[kind] = false;
+			}
+			for (char *name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+				size_t kind = 0;
+				while (kind < KIND_COUNT && strcmp(name, KIND_NAMES[kind]) != 0) {
+					++ kind;
+				}
+				if (kind == KIND_COUNT) {
+					panicf("unknown problem kind: %s", name);
+				}
+				options->kinds[kind] = true;
+			}
+			free(list);
+		}
+		else if (strncmp(arg, "--tasks=", 8) == 0) {
+			char *list = strdup(arg + 8);
+			char *saveptr = NULL;
+			if (!list) {
+				panice("copying numbers of tasks");
+			}
+			options->task_count = 0;
+			for (char *item = strtok_r(list, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+				if (options->task_count == STRESS_MAX_TASKS) {
+					panicf("only up to %d numbers of tasks supported", STRESS_MAX_TASKS);
+				}
+				const size_t tasks = parse_size(item, "number of tasks is not a number");
+				if (tasks == 0) {
+					panicf("number of tasks has to be >= 1");
+				}
+				options->tasks[options->task_count ++] = tasks;
+			}
+			free(list);
+			if (options->task_count == 0) {
+				panicf("empty list of numbers of tasks");
+			}
+		}
+		else {
+			panicf("unknown option: %s", arg);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Options options = {
+		.seed = 1,
+		.count = 20,
+		.kinds = { true, true, true, true },
+		.tasks = { 1, 2, 4 },
+		.task_count = 3
+	};
+	parse_options(argc, argv, &options);
+
+	// one variant per mode and number of threads, reach is single threaded
+	const size_t variant_count = (MODE_COUNT - 1) * options.task_count + 1;
+	const size_t problem_count = options.count * KIND_COUNT;
+	Variant *variants = calloc(variant_count, sizeof(Variant));
+	Result *results = calloc(variant_count, sizeof(Result));
+	if (!variants || !results) {
+		panice("allocating variants");
+	}
+
+	size_t variant_index = 0;
+	for (Mode mode = ModeAll; mode < MODE_COUNT; ++ mode) {
+		for (size_t index = 0; index < (mode == ModeReach ? 1 : options.task_count); ++ index) {
+			Variant *variant = &variants[variant_index ++];
+			variant->mode = mode;
+			variant->tasks = mode == ModeReach ? 1 : options.tasks[index];
+			variant->millis = calloc(problem_count == 0 ? 1 : problem_count, sizeof(double));
+			if (!variant->millis) {
+				panice("allocating latencies");
+			}
+			if (mode != ModeReach) {
+				NumbersOptions pool_options = NUMBERS_OPTIONS_INIT;
+				pool_options.tasks = variant->tasks;
+				variant->pool = numbers_pool_new(&pool_options);
+			}
+		}
+	}
+
+	printf("seed = %llu\n", (unsigned long long)options.seed);
+
+	uint64_t state = options.seed;
+	size_t problems = 0;
+	size_t mismatches = 0;
+
+	for (size_t round = 0; round < options.count; ++ round) {
+		for (Kind kind = KindClassic; kind < KIND_COUNT; ++ kind) {
+			if (!options.kinds[kind]) {
+				continue;
+			}
+
+			Problem problem;
+			generate(&state, kind, variants[0].pool, &problem);
+			++ problems;
+
+			bool reachable[1 << STRESS_MAX_COUNT];
+			const bool brute = problem.count <= STRESS_MAX_BRUTE_COUNT;
+			if (brute) {
+				brute_force(&problem, reachable);
+			}
+
+			for (size_t index = 0; index < variant_count; ++ index) {
+				if (variants[index].mode == ModeReach && !reach_fits(&problem)) {
+					results[index] = (Result){ .solutions = NULL, .count = 0, .capacity = 0, .found = false, .millis = 0 };
+					continue;
+				}
+				solve(&variants[index], &problem, &results[index]);
+				if (variants[index].mode != ModeReach) {
+					sort_texts(&results[index]);
+				}
+			}
+
+			// the results of each mode start with the one of the first number of threads
+			for (size_t index = 0; index < variant_count; ++ index) {
+				const size_t first = index - index % options.task_count;
+				if (variants[index].mode == ModeReach && !reach_fits(&problem)) {
+					continue;
+				}
+				if (!check(&variants[index], &problem, brute ? reachable : NULL, &results[0], &results[first], &results[index])) {
+					fprintf(stderr, "MISMATCH: mode %s, %zu tasks, %zu solutions (reference: %zu)\n  ",
+						MODE_NAMES[variants[index].mode], variants[index].tasks,
+						results[index].count, results[0].count);
+					print_problem(stderr, &problem);
+					++ mismatches;
+				}
+			}
+
+			for (size_t index = 0; index < variant_count; ++ index) {
+				free_result(&results[index]);
+			}
+		}
+	}
+
+	printf("problems = %zu\n\n", problems);
+	printf("%-9s %5s %6s %10s %10s %9s %9s %9s %9s\n",
+		"mode", "tasks", "runs", "solutions", "runs/s", "p50 ms", "p90 ms", "p99 ms", "max ms");
+	for (size_t index = 0; index < variant_count; ++ index) {
+		print_variant(&variants[index]);
+	}
+	printf("\nmismatches = %zu\n", mismatches);
+
+	for (size_t index = 0; index < variant_count; ++ index) {
+		if (variants[index].pool) {
+			numbers_pool_free(variants[index].pool);
+		}
+		free(variants[index].millis);
+	}
+	free(variants);
+	free(results);
+
+	return mismatches == 0 ? 0 : 1;
+}